@@ -2,18 +2,47 @@
 #include <iostream>
 #include <exception>
 #include <string>
+#include <string_view>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
+#include <span>
 #include <memory>
 #include <tuple>
 #include <functional>
 #include <variant>
+#include <optional>
 #include <initializer_list>
 #include <cassert>
+#include <cstring>
 #include <type_traits>
 #include <sstream>
 #include <iomanip>
-
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <limits>
+#include <cerrno>
+#include <system_error>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <future>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SJSON_SSE2 1
+#endif
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "../SRefl/SRefl.hpp"
 
 
@@ -26,6 +55,17 @@ namespace std
     }
 }
 
+namespace SJson
+{
+    class JsonNode;
+}
+
+template<>
+struct std::hash<SJson::JsonNode>
+{
+    size_t operator()(const SJson::JsonNode& node) const;
+};
+
 namespace SJson
 {
     // Type declarations
@@ -34,6 +74,14 @@ namespace SJson
     class JsonConvert;
     struct JsonToken;
     struct JsonFormatOption;
+    class JsonWriter;
+    class JsonSink;
+    struct JsonParseOption;
+    class JsonDocument;
+    template<typename T>
+    class JsonSnapshot;
+    class JsonTape;
+    class JsonElement;
 
     enum class ValueType : uint8_t
     {
@@ -69,21 +117,267 @@ namespace SJson
         __COUNT
     };
 
+    /**
+     * @brief FNV-1a hash of an object key, never 0 so that 0 can mark empty index slots
+     * @param name
+     * @return
+    */
+    constexpr uint64_t hash_key(std::string_view name)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : name)
+        {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash == 0 ? 1 : hash;
+    }
+
+    /**
+     * @brief Mix a 64-bit value into a hash, one FNV-1a step per byte
+     * @param hash
+     * @param value
+     * @return
+    */
+    constexpr uint64_t hash_combine(uint64_t hash, uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            hash ^= (value >> (i * 8)) & 0xFF;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    /**
+     * @brief Object key with a precomputed hash, for lookups repeated in hot loops.
+     * The key only references its characters, which must outlive it.
+    */
+    class JsonKey
+    {
+    public:
+        constexpr explicit JsonKey(std::string_view name) : m_name(name), m_hash(hash_key(name)) {}
+
+        constexpr std::string_view Name() const { return m_name; }
+        constexpr uint64_t Hash() const { return m_hash; }
+    private:
+        std::string_view	m_name;
+        uint64_t			m_hash;
+    };
+
+    inline namespace literals
+    {
+        /**
+         * @brief "FilePath"_jk creates a JsonKey hashed at compile time
+        */
+        constexpr JsonKey operator""_jk(const char* str, size_t length)
+        {
+            return JsonKey(std::string_view(str, length));
+        }
+    }
+
+    /**
+     * @brief Ordered name - value pairs of an object. Objects with many members also keep
+     * an open addressing hash index over the keys, used by JsonKey lookups.
+    */
+    class JsonObject
+    {
+    public:
+        using map_type = std::map<std::string, JsonNode, std::less<>>;
+        using key_type = map_type::key_type;
+        using mapped_type = map_type::mapped_type;
+        using value_type = map_type::value_type;
+        using size_type = map_type::size_type;
+        using iterator = map_type::iterator;
+        using const_iterator = map_type::const_iterator;
+
+        // Objects smaller than this are searched through the map only
+        static constexpr size_t INDEX_THRESHOLD = 8;
+
+        JsonObject() = default;
+        JsonObject(std::initializer_list<value_type> list);
+        JsonObject(const JsonObject& other);
+        JsonObject(JsonObject&& other) noexcept;
+        JsonObject& operator=(const JsonObject& other);
+        JsonObject& operator=(JsonObject&& other) noexcept;
+
+        iterator begin() { return m_members.begin(); }
+        iterator end() { return m_members.end(); }
+        const_iterator begin() const { return m_members.begin(); }
+        const_iterator end() const { return m_members.end(); }
+        size_type size() const { return m_members.size(); }
+        bool empty() const { return m_members.empty(); }
+
+        iterator find(std::string_view name) { return m_members.find(name); }
+        const_iterator find(std::string_view name) const { return m_members.find(name); }
+        iterator find(const JsonKey& key);
+        const_iterator find(const JsonKey& key) const;
+
+        std::pair<iterator, bool> try_emplace(std::string name, JsonNode&& value);
+        size_type erase(std::string_view name);
+        void clear();
+
+        // Bytes reserved by the hash index
+        size_t IndexBytes() const { return m_index.capacity() * sizeof(IndexSlot); }
+    private:
+        struct IndexSlot
+        {
+            uint64_t	Hash;		// 0 if the slot is empty
+            iterator	Entry;
+        };
+
+        // Transparent comparison, so that keys can be looked up without constructing a std::string
+        map_type				m_members;
+        std::vector<IndexSlot>	m_index;
+
+        void index_insert(uint64_t hash, iterator entry);
+        void index_erase(uint64_t hash, iterator entry);
+        void rebuild_index();
+    };
+
     using array_type = std::vector<JsonNode>;
-    using object_type = std::map<std::string, JsonNode>;
+    using object_type = JsonObject;
+
+    /**
+     * @brief Contiguous storage of an array whose elements are all numbers of one type.
+     * Const element access builds the element nodes on first use and keeps them alongside
+    */
+    template<typename T>
+    class JsonPackedArray : public std::vector<T>
+    {
+    public:
+        using std::vector<T>::vector;
+        JsonPackedArray(std::vector<T>&& numbers) : std::vector<T>(std::move(numbers)) {}
+        JsonPackedArray(const JsonPackedArray& other) : std::vector<T>(other) {}
+        JsonPackedArray(JsonPackedArray&& other) noexcept : std::vector<T>(std::move(other)) {}
+        JsonPackedArray& operator=(const JsonPackedArray& other) = delete;
+
+        /**
+         * @brief The numbers as element nodes, built once and safe to call from several threads
+         * @return
+        */
+        const array_type& Nodes() const;
+
+        /**
+         * @brief One number as an element node, built on first access and kept, so that indexed
+         * reads only pay for the elements they touch. Safe to call from several threads
+         * @param index
+         * @return
+        */
+        const JsonNode& Node(size_t index) const;
+
+        // Bytes of the element nodes built so far
+        size_t NodeBytes() const;
+    private:
+        mutable std::mutex											m_mutex;		// Guards building the nodes
+        mutable std::unique_ptr<array_type>							m_nodes;
+        mutable std::atomic<const array_type*>						m_published{ nullptr };	// m_nodes once built, read without the lock
+        mutable std::unique_ptr<std::unordered_map<size_t, JsonNode>>	m_elements;		// Nodes built by Node before Nodes was called
+    };
+
+    using int_array_type = JsonPackedArray<int64_t>;
+    using float_array_type = JsonPackedArray<double>;
+
+    /**
+     * @brief A begin/end pair usable in range-for
+    */
+    template<typename Iterator>
+    struct iterator_range
+    {
+        Iterator first, last;
+        Iterator begin() const { return first; }
+        Iterator end() const { return last; }
+    };
+
     using array_type_init = std::initializer_list<JsonNode>;
     using object_type_init = std::initializer_list<std::pair<const std::string, JsonNode>>;
 
+    /**
+     * @brief Number kept as its source lexeme and converted only when it is read.
+     * The converted value is cached, and the lexeme is what gets serialized, so numbers
+     * round-trip exactly, including integers that do not fit in int64_t.
+    */
+    class JsonNumber
+    {
+    public:
+        /**
+         * @brief
+         * @param lexeme A number accepted by the lexer
+         * @param borrowed True to reference lexeme instead of copying it; it must outlive the number
+        */
+        JsonNumber(std::string_view lexeme, bool borrowed);
+        JsonNumber(const JsonNumber& other);
+        JsonNumber(JsonNumber&& other) noexcept;
+        JsonNumber& operator=(const JsonNumber& other);
+        JsonNumber& operator=(JsonNumber&& other) noexcept;
+        ~JsonNumber();
+
+        std::string_view Text() const;
+        bool IsBorrowed() const { return m_storage == Storage::Borrowed; }
+        size_t HeapSize() const { return m_storage == Storage::Heap ? m_length : 0; }
+        void MakeOwned();
+
+        /**
+         * @brief Convert the lexeme to an integer, throws std::out_of_range if it does not fit
+         * @return
+        */
+        int64_t GetInteger() const;
+        double GetFloat() const;
+
+        /**
+         * @brief Convert an integer lexeme to the nearest double, including integers beyond int64_t.
+         * Not cached, since the cache of an integer holds its int64_t bits
+         * @return
+        */
+        double IntegerToFloat() const;
+    private:
+        enum class Storage : uint8_t
+        {
+            Inline,         // Characters stored in m_inline
+            Borrowed,       // Characters referenced by m_external
+            Heap            // Characters owned by m_external
+        };
+
+        static constexpr size_t INLINE_CAPACITY = 16;
+
+        double parse_float() const;
+        static bool below_one(std::string_view text);
+
+        union
+        {
+            char						m_inline[INLINE_CAPACITY];
+            const char*					m_external;
+        };
+        uint32_t						m_length;
+        Storage							m_storage;
+        mutable std::atomic<bool>		m_cached;
+        mutable std::atomic<uint64_t>	m_cache;		// Bits of the converted int64_t or double
+
+        void assign(std::string_view lexeme, bool borrowed);
+        void release();
+    };
+
     using JsonValue = std::variant<
         std::monostate,
         int64_t,
         double,
+        float,			// Floats that originated as float, printed with float precision
         bool,
         std::string,
-        array_type,
-        object_type
+        std::string_view,
+        JsonNumber,
+        // Containers are reference counted and copied on write, so copying a node is O(1)
+        std::shared_ptr<array_type>,
+        std::shared_ptr<object_type>,
+        std::shared_ptr<int_array_type>,
+        std::shared_ptr<float_array_type>
     >;
 
+    template<typename T>
+    struct is_shared_ptr : std::false_type {};
+    template<typename T>
+    struct is_shared_ptr<std::shared_ptr<T>> : std::true_type {};
+
     template <typename T, typename U>
     using t_enable_if_same_type = std::enable_if_t<std::is_same<std::decay_t<T>, U>::value, nullptr_t>;
 
@@ -114,6 +408,20 @@ namespace SJson
     */
     JsonNode array(std::initializer_list<JsonNode> list);
 
+    /**
+     * @brief Create a string node that references value without copying it
+     * @param value Characters that must outlive the node (and every copy of it)
+     * @return
+    */
+    JsonNode borrow(std::string_view value);
+
+    /**
+     * @brief Create a number node from its text, keeping the text exactly as given
+     * @param lexeme Throws std::invalid_argument if this is not a number
+     * @return
+    */
+    JsonNode number(std::string_view lexeme);
+
 
     /**
      * @brief
@@ -122,7 +430,7 @@ namespace SJson
      * @param newIndex
      * @return
     */
-    JsonNode parse(const std::vector<JsonToken>& tokens, int index, int& newIndex);
+    JsonNode parse(const std::vector<JsonToken>& tokens, int index, int& newIndex, const JsonParseOption& option);
 
     /**
      * @brief 
@@ -152,10 +460,10 @@ namespace SJson
 
     struct JsonToken
     {
-        std::string						Value;
+        std::string_view				Value;
         TokenType						Token;
         int								Position;
-        std::shared_ptr<std::string>	OriginalText;
+        std::string_view				OriginalText;
     };
 
 
@@ -165,8 +473,8 @@ namespace SJson
         explicit sjson_error_base(const std::string& reason, const JsonToken& token)
         {
             int left = std::max(token.Position - 15, 0);
-            int right = std::min(token.Position + 15, (int)token.OriginalText->size() - 1);
-            std::string view = token.OriginalText->substr(left, right - left + 1);
+            int right = std::min(token.Position + 15, (int)token.OriginalText.size() - 1);
+            std::string view = std::string(token.OriginalText.substr(left, right - left + 1));
             std::string viewptr = "";
             int offset = token.Position - left;
             for (int i = 0; i < offset; i++)
@@ -258,10 +566,35 @@ namespace SJson
     {
     public:
         static JsonNode Parse(const std::string& text);
+        static JsonNode Parse(std::string_view text, const JsonParseOption& option);
+        static JsonNode Parse(const char* text, const JsonParseOption& option);
+
+        /**
+         * @brief Borrowed strings would reference the temporary once it is destroyed
+        */
+        static JsonNode Parse(std::string&& text, const JsonParseOption& option) = delete;
 
         template<typename T>
         static std::string Serialize(const T& v, const JsonFormatOption& option);
 
+        /**
+         * @brief Serialize straight into a sink, without holding the whole text in memory
+         * @param v
+         * @param sink
+         * @param option
+        */
+        template<typename T>
+        static void SerializeTo(const T& v, JsonSink& sink, const JsonFormatOption& option);
+
+        /**
+         * @brief Exact length of Serialize(v, option), counted without producing the text
+         * @param v
+         * @param option
+         * @return
+        */
+        template<typename T>
+        static size_t SerializedSize(const T& v, const JsonFormatOption& option);
+
         template<typename T>
         static T Deserialize(const std::string jsonStr);
     };
@@ -271,11 +604,271 @@ namespace SJson
         bool		Inline;				// Whether we should indent and make new-line when necessary
         bool		UseTab;				// True if we use tab to indent
         bool		KeysWithQuotes;		// True if we want keys to have quotes
+        bool		EscapeNonAscii;		// True if characters beyond ASCII are written as \uXXXX
+        bool		Minify = false;				// True if no whitespace is written at all, implies Inline
+        uint8_t		IndentWidth = 2;			// Spaces per level when indenting without tabs
+        uint32_t	ShortArrayLength = 0;		// Arrays of at most this many scalars stay on one line, 0 to always break them
+        bool		Canonical = false;			// True for RFC 8785 text: minified, keys sorted by UTF-16 code units, numbers as ECMAScript doubles
+        uint32_t	MaxThreads = 1;				// Threads writing long arrays and objects, 1 to stay on the calling thread, 0 for one per hardware thread
+        bool		PreMeasure = false;			// True if ToString and Serialize count the text first, so the string is allocated once
+    };
+
+    const JsonFormatOption DefaultOption = { true, false, false, false };
+    const JsonFormatOption InlineWithQuoteOption = { true, false, true, false };
+    const JsonFormatOption DocumentOption = { false, false, true, false };
+    const JsonFormatOption MinifiedOption = { true, false, true, false, true };
+    const JsonFormatOption CanonicalOption = { true, false, true, false, true, 0, 0, true };
+
+    /**
+     * @brief Destination of serialized text, receiving it in chunks
+    */
+    class JsonSink
+    {
+    public:
+        virtual ~JsonSink() = default;
+        virtual void Write(std::string_view data) = 0;
+        virtual void Flush() {}
+    };
+
+    class JsonStreamSink : public JsonSink
+    {
+    public:
+        explicit JsonStreamSink(std::ostream& stream) : m_stream(stream) {}
+        void Write(std::string_view data) override;
+        void Flush() override;
+    private:
+        std::ostream& m_stream;
+    };
+
+    class JsonFileSink : public JsonSink
+    {
+    public:
+        explicit JsonFileSink(FILE* file) : m_file(file) {}
+        void Write(std::string_view data) override;
+        void Flush() override;
+    private:
+        FILE* m_file;
+    };
+
+    /**
+     * @brief Writes to a file descriptor through a fixed buffer, so that small writes do
+     * not each cost a system call. Flushed on destruction, but only an explicit Flush reports errors
+    */
+    class JsonFdSink : public JsonSink
+    {
+    public:
+        explicit JsonFdSink(int fd) : m_fd(fd), m_size(0) {}
+        JsonFdSink(const JsonFdSink& other) = delete;
+        JsonFdSink& operator=(const JsonFdSink& other) = delete;
+        ~JsonFdSink() override;
+        void Write(std::string_view data) override;
+        void Flush() override;
+    private:
+        static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+        int		m_fd;
+        size_t	m_size;
+        char	m_buffer[BUFFER_SIZE];
+
+        void write_fd(const char* data, size_t size);
+    };
+
+    class JsonCallbackSink : public JsonSink
+    {
+    public:
+        explicit JsonCallbackSink(std::function<void(std::string_view)> callback) : m_callback(std::move(callback)) {}
+        void Write(std::string_view data) override { m_callback(data); }
+    private:
+        std::function<void(std::string_view)> m_callback;
+    };
+
+    /**
+     * @brief Hashes the text with 64-bit FNV-1a instead of storing it
+    */
+    class JsonHashSink : public JsonSink
+    {
+    public:
+        void Write(std::string_view data) override;
+        uint64_t Hash() const { return m_hash; }
+    private:
+        uint64_t m_hash = 14695981039346656037ull;
+    };
+
+    /**
+     * @brief Writes into a caller-owned buffer, typically sized with SerializedSize.
+     * Throws std::length_error instead of writing past the end
+    */
+    class JsonBufferSink : public JsonSink
+    {
+    public:
+        JsonBufferSink(char* data, size_t capacity) : m_data(data), m_capacity(capacity), m_size(0) {}
+        void Write(std::string_view data) override;
+        size_t Size() const { return m_size; }
+    private:
+        char*	m_data;
+        size_t	m_capacity;
+        size_t	m_size;
+    };
+
+    /**
+     * @brief Text written for an object key known ahead of time, already quoted or not
+     * and followed by the separator, so that the writer emits it with one copy
+    */
+    struct JsonKeyLiteral
+    {
+        std::string_view	Quoted;		// "Name": 
+        std::string_view	Unquoted;	// Name: 
+    };
+
+    /**
+     * @brief Writes JSON text event by event into one growing buffer, formatted exactly
+     * like JsonNode::ToString. Objects take a Key before each value
+    */
+    class JsonWriter
+    {
+    public:
+        explicit JsonWriter(const JsonFormatOption& format);
+
+        /**
+         * @brief Pass the text on to sink whenever the buffer fills up. Call Flush when done
+         * @param sink
+         * @param format
+        */
+        JsonWriter(JsonSink& sink, const JsonFormatOption& format);
+
+        /**
+         * @brief Create a writer that only counts the characters it would write
+         * @param format
+         * @return
+        */
+        static JsonWriter Measure(const JsonFormatOption& format);
+
+        void StartObject();
+        void EndObject();
+        void StartArray();
+
+        /**
+         * @brief Start an array of known length, kept on one line if it holds at most
+         * ShortArrayLength elements and none of them is an array or object
+         * @param length
+         * @param scalars True if no element is an array or object
+        */
+        void StartArray(size_t length, bool scalars);
+        void EndArray();
+        void Key(std::string_view name);
+        void Key(const JsonKeyLiteral& key);
+
+        /**
+         * @brief Write a bool, a number or a string
+         * @tparam T bool, any arithmetic type, or anything convertible to std::string_view
+         * @param value
+        */
+        template<typename T>
+        void Value(const T& value);
+        void Null();
+
+        /**
+         * @brief Write text that is already valid JSON, such as the lexeme of a number
+         * @param text
+        */
+        void RawValue(std::string_view text);
+
+        /**
+         * @brief Write the elements of the current array or object, calling write(writer, element)
+         * for each one. If the format allows several threads, long ranges are split into chunks
+         * written on the threads of JsonWorkerPool into separate writers and appended in order,
+         * so the text is the same as writing them one by one
+         * @param begin
+         * @param end
+         * @param write Must only read shared state; chunk writers never go parallel themselves
+        */
+        template<typename It, typename F>
+        void WriteRange(It begin, It end, F&& write);
+
+        const JsonFormatOption& Format() const { return m_format; }
+
+        const std::string& GetString() const { return m_buffer; }
+        std::string Take() { return std::move(m_buffer); }
+
+        /**
+         * @brief Number of characters written so far, including those passed to the sink
+         * @return
+        */
+        size_t Size() const { return m_size; }
+        void Reserve(size_t size) { m_buffer.reserve(size); }
+
+        /**
+         * @brief Hand the buffered text to the sink and flush it
+        */
+        void Flush();
+    private:
+        static constexpr size_t SINK_CHUNK_SIZE = 64 * 1024;
+        static constexpr size_t PARALLEL_MIN_CHUNK = 16 * 1024;		// Elements per chunk below which threads do not pay off
+        static constexpr size_t PARALLEL_WAVE_CHUNKS = 4;			// Chunks per thread, so that only part of the text is held at once
+
+        struct Scope
+        {
+            bool	IsObject;
+            size_t	Count;
+            bool	SingleLine;
+        };
+
+        JsonFormatOption	m_format;
+        std::string			m_buffer;
+        std::string			m_indent;		// Indentation of the deepest level so far, sliced for shallower ones
+        std::vector<Scope>	m_scopes;
+        JsonSink*			m_sink;
+        bool				m_measure;
+        size_t				m_size;
+        size_t				m_maxThreads;
+
+        JsonWriter(const JsonWriter& parent, size_t index);
+
+        void put(char c);
+        void put(std::string_view text);
+        void append_chunk(const JsonWriter& chunk);
+        void flush_if_full();
+        void start_value();
+        void separate();
+        void indent(size_t depth);
+        bool breaks_lines() const;
+        void start_scope(char open, bool isObject, bool singleLine = false);
+        void end_scope(char close);
+        template<typename T>
+        void write_float(T value);
+        void write_canonical_number(double value);
+        void write_escaped(std::string_view text);
+    };
+
+    struct JsonParseOption
+    {
+        bool		BorrowStrings;		// True if escape-free string values reference the source text instead of copying it
+        bool		LazyNumbers;		// True if numbers of strict RFC 8259 form keep their text and are converted only when read
+        bool		PackNumericArrays;	// True if arrays of only integers or only floats are stored as contiguous int64_t / double buffers
+        bool		Deduplicate;		// True if identical arrays and objects share a single instance, see JsonNode::Deduplicate
     };
 
-    const JsonFormatOption DefaultOption = { true, false, false };
-    const JsonFormatOption InlineWithQuoteOption = { true, false, true };
-    const JsonFormatOption DocumentOption = { false, false, true };
+    const JsonParseOption DefaultParseOption = { false, false, false, false };
+    const JsonParseOption BorrowedParseOption = { true, false, false, false };
+    const JsonParseOption LazyParseOption = { false, true, false, false };
+    const JsonParseOption PackedParseOption = { false, false, true, false };
+
+    /**
+     * @brief Estimated bytes of memory held by a tree, broken down by what they are spent on.
+     * Payloads shared by several nodes are counted once
+    */
+    struct JsonMemoryUsage
+    {
+        size_t		Nodes = 0;			// JsonNode objects, including array elements and object values
+        size_t		Containers = 0;		// Array and object payloads: allocation headers, map tree links, key indices
+        size_t		Keys = 0;			// Object keys, both the std::string objects and their heap characters
+        size_t		Strings = 0;		// Heap characters of owned string values and long lazy numbers
+        size_t		Packed = 0;			// Numbers in packed numeric arrays
+        size_t		Slack = 0;			// Reserved but unused capacity of vectors and strings
+        size_t		Text = 0;			// Source text owned by a JsonDocument
+
+        size_t Total() const { return Nodes + Containers + Keys + Strings + Packed + Slack + Text; }
+    };
 
     // using JsonValue = void*;
     class JsonNode
@@ -292,6 +885,13 @@ namespace SJson
         JsonNode(const std::string& value);
         JsonNode(array_type_init list);
         JsonNode(object_type_init list);
+        JsonNode(const JsonNode& other);
+        /**
+         * @brief Moving leaves the source node null
+        */
+        JsonNode(JsonNode&& other) noexcept;
+        JsonNode& operator=(const JsonNode& other);
+        JsonNode& operator=(JsonNode&& other) noexcept;
 
         ~JsonNode();
 
@@ -310,794 +910,4420 @@ namespace SJson
         template<typename T>
         T Get() const;
 
+        /**
+         * @brief Move the value out of an expiring node instead of copying it
+         * @tparam T Any type supported by Get, or array_type / object_type
+         * @return
+        */
+        template<typename T>
+        T Take() &&;
+
+        /**
+         * @brief Move the underlying value out of an expiring node, leaving it null
+         * @return
+        */
+        JsonValue Release() &&;
+
+        /**
+         * @brief Get the string value without copying it
+         * @return A view that is valid as long as this node is alive and unmodified
+        */
+        std::string_view GetStringView() const;
+
+        /**
+         * @brief Get the elements of an array. A packed numeric array is unpacked by the
+         * non-const overload and throws std::logic_error in the const one
+         * @return
+        */
+        std::span<JsonNode> AsArray();
+        std::span<const JsonNode> AsArray() const;
+
+        /**
+         * @brief Check whether this array is stored as a contiguous buffer of numbers
+         * @return
+        */
+        bool IsPacked() const;
+
+        /**
+         * @brief Get the buffer of a packed numeric array
+         * @tparam T int64_t or double, matching the storage
+         * @return
+        */
+        template<typename T>
+        std::span<const T> GetNumbers() const;
+
+        /**
+         * @brief Append every element of an array of numbers to out, converted to T
+         * @tparam T Any arithmetic type
+         * @param out
+        */
+        template<typename T>
+        void CopyNumbers(std::vector<T>& out) const;
+
+        /**
+         * @brief Convert a packed numeric array back to an array of nodes
+        */
+        void Unpack();
+
+        /**
+         * @brief Number of elements of an array or members of an object
+         * @return
+        */
+        size_t Size() const;
+
+        /**
+         * @brief Check whether the array or object payload is shared with another node.
+         * Copies share their payload until one of them is accessed through a non-const member.
+         * A node that has handed out references meant to be kept, through AsObject, AsArray,
+         * Find, items or iterators, is copied deeply instead
+         * @return
+        */
+        bool IsShared() const;
+        object_type& AsObject();
+        const object_type& AsObject() const;
+
         ValueType GetType() const { return m_type; }
         std::string ToString(const JsonFormatOption& format) const;
 
-        void foreach(std::function<void(const JsonNode&)> action) const;
-        void foreach_pairs(std::function<void(const std::string&, const JsonNode&)> action) const;
+        /**
+         * @brief Write this subtree to a sink in chunks, and flush it
+         * @param sink
+         * @param format
+        */
+        void WriteTo(JsonSink& sink, const JsonFormatOption& format) const;
+
+        /**
+         * @brief Exact length of ToString(format), counted without producing the text
+         * @param format
+         * @return
+        */
+        size_t SerializedSize(const JsonFormatOption& format) const;
+
+        /**
+         * @brief Write this subtree as one value
+         * @param writer
+        */
+        void Write(JsonWriter& writer) const;
+
+        /**
+         * @brief Check whether this is a string or lazy number referencing a buffer it does not own
+         * @return
+        */
+        bool IsBorrowed() const;
+
+        /**
+         * @brief Check whether this number is kept as text until it is read
+         * @return
+        */
+        bool IsLazyNumber() const { return std::holds_alternative<JsonNumber>(m_value); }
+
+        /**
+         * @brief Get the source text of a lazy number
+         * @return
+        */
+        std::string_view GetNumberText() const;
+
+        /**
+         * @brief Get the string value for modification, promoting a borrowed string to an owned one
+         * @return
+        */
+        std::string& GetMutableString();
+
+        /**
+         * @brief Promote every borrowed string in this subtree to an owned copy,
+         * so that the subtree no longer depends on the source buffer
+        */
+        void MakeOwned();
+
+        /**
+         * @brief Make identical arrays and objects of this subtree share one instance.
+         * Subtrees are identical if they print the same, so reads are unaffected, and since
+         * containers are copied on write, modifying a shared subtree only changes that node
+        */
+        void Deduplicate();
+
+        /**
+         * @brief Hash consistent with operator==. The hash of an array or object is cached
+         * until it is accessed through a non-const member, unless a mutable reference into
+         * the subtree may still be held
+         * @return
+        */
+        uint64_t Hash() const;
+
+        /**
+         * @brief RFC 8785 canonical text, the same for equal trees however they were built.
+         * Integers are written as doubles, so those beyond 2^53 lose precision
+         * @return
+        */
+        std::string ToCanonical() const;
+
+        /**
+         * @brief 64-bit FNV-1a hash of ToCanonical(), computed without holding the whole text
+         * @return
+        */
+        uint64_t CanonicalHash() const;
+
+        /**
+         * @brief Estimate the memory held by this subtree, this node included
+         * @return
+        */
+        JsonMemoryUsage MemoryUsage() const;
+
+        /**
+         * @brief Structural equality. Borrowed and owned strings, lazy and converted numbers,
+         * packed and unpacked arrays compare by value; integers never equal floats
+         * @param other
+         * @return
+        */
+        bool operator==(const JsonNode& other) const;
+
+        template<typename F>
+        void foreach(F&& action) const;
+        template<typename F>
+        void foreach_pairs(F&& action) const;
+
+        /**
+         * @brief Iterate over the elements of an array
+         * @return
+        */
+        JsonNode* begin();
+        JsonNode* end();
+        const JsonNode* begin() const;
+        const JsonNode* end() const;
+
+        /**
+         * @brief Iterate over the name - value pairs of an object
+         * @return
+        */
+        iterator_range<object_type::iterator> items();
+        iterator_range<object_type::const_iterator> items() const;
 
         void push_back(JsonNode&& node);
         void push_back(const JsonNode& node);
 
-        JsonNode& operator[](const std::string& name);
-        const JsonNode& operator[](const std::string& name) const;
+        /**
+         * @brief Find a member of an object
+         * @param name
+         * @return The member, or nullptr if this is not an object or the key does not exist
+        */
+        JsonNode* Find(std::string_view name);
+        const JsonNode* Find(std::string_view name) const;
+
+        /**
+         * @brief Find a member of an object through its hash index
+         * @param key
+         * @return The member, or nullptr if this is not an object or the key does not exist
+        */
+        JsonNode* Find(const JsonKey& key);
+        const JsonNode* Find(const JsonKey& key) const;
+
+        /**
+         * @brief Access a member or element. The non-const overloads return a reference meant for
+         * immediate use and keep copies cheap: a copy made while it is held may share what it
+         * modifies. Obtain references to keep through Find, AsObject or AsArray
+        */
+        JsonNode& operator[](std::string_view name);
+        const JsonNode& operator[](std::string_view name) const;
+        JsonNode& operator[](const JsonKey& key);
+        const JsonNode& operator[](const JsonKey& key) const;
         JsonNode& operator[](size_t index);
         const JsonNode& operator[](size_t index) const;
     private:
         ValueType m_type;
+        bool m_exposed = false;		// A mutable reference into the payload may be kept, so copies must not share it
+        bool m_lent = false;		// A mutable reference into the payload may still be held, so the hash is not cached
         JsonValue m_value;
+        mutable std::atomic<uint64_t> m_hash{ 0 };		// Cached Hash() of an array or object, 0 if unknown
 
-        std::string internal_tostring(const JsonFormatOption& format, int level) const;
-    };
+        explicit JsonNode(std::string_view value);
+        JsonNode(JsonNumber&& value, ValueType type);
+        explicit JsonNode(int_array_type&& value);
+        explicit JsonNode(float_array_type&& value);
 
+        array_type& mutable_array();
+        const array_type& const_array() const;
 
-    inline JsonNode::~JsonNode()
-    {
-    }
+        template<typename T>
+        const T* payload() const;
+        template<typename T>
+        T* mutable_payload();
+        template<typename T>
+        T* lent_payload();
+        template<typename T>
+        T* exposed_payload();
+        void clone_payload();
+        const void* payload_address() const;
+
+        struct dedup_table;
+        uint64_t deduplicate(dedup_table& table);
+        uint64_t deduplicate(dedup_table& table) const;
+        template<typename Node>
+        static uint64_t content_hash(Node& node, dedup_table& table);
+        const JsonValue* find_canonical(const dedup_table& table, uint64_t hash) const;
+        uint64_t scalar_hash() const;
+        uint64_t compute_hash(bool& cacheable) const;
+        bool same_payload(const JsonValue& other) const;
+        static bool identical(const JsonNode& lhs, const JsonNode& rhs);
+        static uint64_t hash_integer(int64_t value);
+        static uint64_t hash_float(double value);
+        bool number_equal(const JsonNode& other) const;
+        void memory_usage(JsonMemoryUsage& usage, std::unordered_set<const void*>& visited) const;
+        template<typename F>
+        void visit_element(size_t index, F&& action) const;
+
+        friend JsonNode borrow(std::string_view value);
+        friend JsonNode number(std::string_view lexeme);
+        friend JsonNode parse(const std::vector<JsonToken>& tokens, int index, int& newIndex, const JsonParseOption& option);
+        friend bool try_parse_packed_array(const std::vector<JsonToken>& tokens, int index, int& newIndex, JsonNode& node);
+    };
 
-    inline JsonNode::JsonNode()
-        : m_type(ValueType::Null), m_value(std::monostate())
+    /**
+     * @brief Owns a JSON text buffer together with the tree parsed from it, so that
+     * string values can reference the buffer instead of being copied
+    */
+    class JsonDocument
     {
-    }
+    public:
+        explicit JsonDocument(std::string text, const JsonParseOption& option = BorrowedParseOption);
 
-    template<typename T, t_enable_if_same_type<T, bool>>
-    inline JsonNode::JsonNode(T value)
-        : m_type(ValueType::Boolean), m_value(static_cast<bool>(value))
+        JsonDocument(JsonDocument&& other) = default;
+        JsonDocument& operator=(JsonDocument&& other) = default;
+        JsonDocument(const JsonDocument& other) = delete;
+        JsonDocument& operator=(const JsonDocument& other) = delete;
+
+        JsonNode& Root() { return m_root; }
+        const JsonNode& Root() const { return m_root; }
+        std::string_view Text() const { return *m_text; }
+        JsonMemoryUsage MemoryUsage() const;
+    private:
+        // Heap allocated so that moving the document never moves the characters
+        std::unique_ptr<std::string>	m_text;
+        JsonNode						m_root;
+    };
+
+    /**
+     * @brief Holds the current version of an immutable value for many concurrent readers.
+     * Reading is wait-free; publishing replaces the version atomically and destroys the old
+     * one once every reader that could still see it has released it.
+     * @tparam T The value is only ever accessed through const references once published
+    */
+    template<typename T>
+    class JsonSnapshot
     {
-    }
+    public:
+        /**
+         * @brief Keeps one version alive while it is being read. Guards should be short lived,
+         * since a publisher waits for the guards of the version it replaces
+        */
+        class ReadGuard
+        {
+        public:
+            ReadGuard(ReadGuard&& other) noexcept;
+            ReadGuard(const ReadGuard& other) = delete;
+            ReadGuard& operator=(const ReadGuard& other) = delete;
+            ReadGuard& operator=(ReadGuard&& other) = delete;
+            ~ReadGuard();
+
+            const T& operator*() const { return *m_value; }
+            const T* operator->() const { return m_value; }
+            const T& Get() const { return *m_value; }
+        private:
+            ReadGuard(std::atomic<uint64_t>* readers, const T* value) : m_readers(readers), m_value(value) {}
+
+            std::atomic<uint64_t>*	m_readers;
+            const T*				m_value;
+
+            friend class JsonSnapshot;
+        };
 
-    template<typename T, t_enable_if_integral_type<T>>
-    inline JsonNode::JsonNode(T value)
-        : m_type(ValueType::Integer), m_value(static_cast<int64_t>(value))
+        explicit JsonSnapshot(T value);
+        JsonSnapshot(const JsonSnapshot& other) = delete;
+        JsonSnapshot& operator=(const JsonSnapshot& other) = delete;
+        ~JsonSnapshot();
+
+        /**
+         * @brief Pin the current version, never blocks
+         * @return
+        */
+        ReadGuard Read() const;
+
+        /**
+         * @brief Make value the current version. Returns after the replaced version is destroyed;
+         * concurrent publishers are serialized
+         * @param value
+        */
+        void Publish(T value);
+    private:
+        // Readers register in the slot selected by the epoch parity before loading the pointer.
+        // A publisher moves the epoch away from each slot in turn and waits for it to drain,
+        // so new readers never keep the slot being waited on busy
+        struct alignas(64) ReaderSlot
+        {
+            std::atomic<uint64_t>	Count{ 0 };
+        };
+
+        std::atomic<T*>				m_current;
+        std::atomic<uint64_t>		m_epoch;
+        mutable ReaderSlot			m_readers[2];
+        std::mutex					m_publish;
+    };
+
+    /**
+     * @brief A document that can be hot-reloaded while it is being read
+    */
+    using SharedDocument = JsonSnapshot<JsonDocument>;
+
+    /**
+     * @brief Background thread destroying values handed to DeferredRelease
+    */
+    class JsonReclaimer
     {
-    }
+    public:
+        static JsonReclaimer& Instance();
 
-    template<typename T, t_enable_if_floating_type<T>>
-    inline JsonNode::JsonNode(T value)
-        : m_type(ValueType::Float), m_value(static_cast<double>(value))
+        /**
+         * @brief Take ownership of a value and destroy it on the reclaimer thread
+         * @param value
+        */
+        void Release(std::shared_ptr<void> value);
+
+        /**
+         * @brief Block until every value released so far has been destroyed
+        */
+        void Flush();
+
+        ~JsonReclaimer();
+    private:
+        JsonReclaimer();
+
+        std::mutex							m_mutex;
+        std::condition_variable				m_wake;
+        std::condition_variable				m_idle;
+        std::deque<std::shared_ptr<void>>	m_pending;
+        bool								m_busy;
+        bool								m_stop;
+        std::thread							m_thread;
+
+        void run();
+    };
+
+    /**
+     * @brief Threads shared by every JsonWriter::WriteRange, started on first use and kept
+     * until the program exits
+    */
+    class JsonWorkerPool
     {
-    }
+    public:
+        static JsonWorkerPool& Instance();
+
+        /**
+         * @brief Queue count runs of task, each on a thread of its own. Threads are started as
+         * needed, and if one cannot be started nothing is queued
+         * @param task Must not throw
+         * @param count
+         * @param pending Set to count, and decremented as each run finishes; pass it to Wait
+        */
+        void Run(const std::function<void()>& task, size_t count, size_t& pending);
+
+        /**
+         * @brief Block until every run counted by pending has finished and its thread is free again
+         * @param pending
+        */
+        void Wait(const size_t& pending);
+
+        /**
+         * @brief Number of threads started so far
+         * @return
+        */
+        size_t Size();
+
+        ~JsonWorkerPool();
+    private:
+        JsonWorkerPool();
 
+        std::mutex								m_mutex;
+        std::condition_variable					m_wake;
+        std::condition_variable					m_done;
+        std::deque<std::pair<std::function<void()>, size_t*>>	m_tasks;
+        std::vector<std::thread>				m_threads;
+        size_t									m_idle;		// Threads not running a task, queued tasks included
+        bool									m_stop;
 
-    inline JsonNode::JsonNode(const char* value)
-        : m_type(ValueType::String), m_value(std::string(value))
+        void run();
+    };
+
+    /**
+     * @brief Move a node or document to the reclaimer thread, so that freeing a large
+     * tree does not stall the calling thread
+     * @param value
+    */
+    template<typename T>
+    void DeferredRelease(T&& value);
+
+
+    inline JsonNode::JsonNode(const JsonNode& other)
+        : m_type(other.m_type), m_exposed(false), m_lent(false), m_value(other.m_value), m_hash(other.m_hash.load(std::memory_order_relaxed))
     {
+        if (other.m_exposed)
+        {
+            clone_payload();
+        }
     }
 
-    inline JsonNode::JsonNode(const std::string& value)
-        : m_type(ValueType::String), m_value(value)
+    inline JsonNode::JsonNode(JsonNode&& other) noexcept
+        : m_type(other.m_type), m_exposed(other.m_exposed), m_lent(other.m_lent), m_value(std::move(other.m_value)), m_hash(other.m_hash.load(std::memory_order_relaxed))
     {
+        other.m_type = ValueType::Null;
+        other.m_exposed = false;
+        other.m_lent = false;
+        other.m_value = std::monostate();
+        other.m_hash.store(0, std::memory_order_relaxed);
     }
 
-    inline JsonNode::JsonNode(array_type_init list)
-        : m_type(ValueType::Array), m_value(array_type(list))
+    inline JsonNode& JsonNode::operator=(const JsonNode& other)
     {
+        if (this != &other)
+        {
+            m_type = other.m_type;
+            m_exposed = false;
+            m_lent = false;
+            m_value = other.m_value;
+            m_hash.store(other.m_hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            if (other.m_exposed)
+            {
+                clone_payload();
+            }
+        }
+        return *this;
     }
 
-    inline JsonNode::JsonNode(object_type_init list)
-        : m_type(ValueType::Object), m_value(object_type(list))
+    inline JsonNode& JsonNode::operator=(JsonNode&& other) noexcept
     {
+        if (this != &other)
+        {
+            m_type = other.m_type;
+            m_exposed = other.m_exposed;
+            m_lent = other.m_lent;
+            m_value = std::move(other.m_value);
+            m_hash.store(other.m_hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            other.m_type = ValueType::Null;
+            other.m_exposed = false;
+            other.m_lent = false;
+            other.m_value = std::monostate();
+            other.m_hash.store(0, std::memory_order_relaxed);
+        }
+        return *this;
     }
 
-    //template<typename T>
-    //inline T JsonNode::Get() const
-    //{
-    //	static_assert(false, "Cannot get an un-supportted type");
-    //}
-
-    template<typename T>
-    inline T JsonNode::Get() const
+    inline JsonNode::~JsonNode()
     {
-        if constexpr (std::is_same<std::decay_t<T>, bool>::value)
-        {
-            assert(m_type == ValueType::Boolean);
-            return std::get<bool>(m_value);
-        }
-        else if constexpr (std::is_integral<std::decay_t<T>>::value && !std::is_same<std::decay_t<T>, bool>::value)
-        {
-            assert(m_type == ValueType::Integer);
-            return static_cast<T>(std::get<int64_t>(m_value));
-        }
-        else if constexpr (std::is_floating_point<std::decay_t<T>>::value)
-        {
-            assert(m_type == ValueType::Float);
-            return static_cast<T>(std::get<double>(m_value));
-        }
-        else
+        // Containers owned only by this subtree are detached from their parents and destroyed
+        // one at a time, so that destroying a deep tree does not recurse
+        std::vector<JsonValue> pending;
+        auto detach = [&pending](JsonValue& value) {
+            auto detachNode = [&pending](JsonNode& node) {
+                if (node.m_type == ValueType::Array || node.m_type == ValueType::Object)
+                {
+                    // A failed push_back leaves the value where it was
+                    static_assert(std::is_nothrow_move_constructible<JsonValue>::value);
+                    try
+                    {
+                        pending.push_back(std::move(node.m_value));
+                    }
+                    catch (const std::bad_alloc&)
+                    {
+                        // Left attached, the subtree is destroyed recursively with its parent
+                        return;
+                    }
+                    node.m_value = std::monostate();
+                }
+            };
+            if (auto array = std::get_if<std::shared_ptr<array_type>>(&value))
+            {
+                if (array->use_count() == 1)
+                {
+                    for (auto& element : **array)
+                    {
+                        detachNode(element);
+                    }
+                }
+            }
+            else if (auto object = std::get_if<std::shared_ptr<object_type>>(&value))
+            {
+                if (object->use_count() == 1)
+                {
+                    for (auto& pair : **object)
+                    {
+                        detachNode(pair.second);
+                    }
+                }
+            }
+        };
+        detach(m_value);
+        while (!pending.empty())
         {
-            static_assert(false, "Cannot get an un-supportted type");
+            JsonValue value = std::move(pending.back());
+            pending.pop_back();
+            detach(value);
         }
     }
 
-    template<>
-    inline std::string JsonNode::Get() const
+    inline JsonNumber::JsonNumber(std::string_view lexeme, bool borrowed)
+        : m_cached(false), m_cache(0)
     {
-        assert(m_type == ValueType::String);
-        return std::get<std::string>(m_value);
+        assign(lexeme, borrowed);
     }
 
+    inline JsonNumber::JsonNumber(const JsonNumber& other)
+        : m_cached(other.m_cached.load(std::memory_order_acquire)),
+        m_cache(other.m_cache.load(std::memory_order_relaxed))
+    {
+        assign(other.Text(), other.IsBorrowed());
+    }
 
-    inline std::string JsonNode::ToString(const JsonFormatOption& format) const
+    inline JsonNumber::JsonNumber(JsonNumber&& other) noexcept
+        : m_length(other.m_length), m_storage(other.m_storage),
+        m_cached(other.m_cached.load(std::memory_order_acquire)),
+        m_cache(other.m_cache.load(std::memory_order_relaxed))
     {
-        return internal_tostring(format, 0);
+        std::memcpy(m_inline, other.m_inline, INLINE_CAPACITY);
+        // The heap buffer now belongs to this number
+        other.m_storage = Storage::Inline;
+        other.m_length = 0;
     }
 
-    inline void JsonNode::foreach(std::function<void(const JsonNode&)> action) const
+    inline JsonNumber& JsonNumber::operator=(const JsonNumber& other)
     {
-        assert(m_type == ValueType::Array);
-        for (auto& element : std::get<array_type>(m_value))
+        if (this != &other)
         {
-            action(element);
+            release();
+            assign(other.Text(), other.IsBorrowed());
+            m_cache.store(other.m_cache.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            m_cached.store(other.m_cached.load(std::memory_order_acquire), std::memory_order_release);
         }
+        return *this;
     }
 
-    inline void JsonNode::foreach_pairs(std::function<void(const std::string&, const JsonNode&)> action) const
+    inline JsonNumber& JsonNumber::operator=(JsonNumber&& other) noexcept
     {
-        assert(m_type == ValueType::Object);
-        for (auto& pair : std::get<object_type>(m_value))
+        if (this != &other)
         {
-            action(pair.first, pair.second);
+            release();
+            std::memcpy(m_inline, other.m_inline, INLINE_CAPACITY);
+            m_length = other.m_length;
+            m_storage = other.m_storage;
+            m_cache.store(other.m_cache.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            m_cached.store(other.m_cached.load(std::memory_order_acquire), std::memory_order_release);
+            other.m_storage = Storage::Inline;
+            other.m_length = 0;
         }
+        return *this;
     }
 
-    inline void JsonNode::push_back(JsonNode&& node)
+    inline JsonNumber::~JsonNumber()
     {
-        assert(m_type == ValueType::Array);
-        std::get<array_type>(m_value).push_back(std::move(node));
+        release();
     }
 
-    inline void JsonNode::push_back(const JsonNode& node)
+    inline std::string_view JsonNumber::Text() const
     {
-        assert(m_type == ValueType::Array);
-        std::get<array_type>(m_value).push_back(node);
+        if (m_storage == Storage::Inline)
+        {
+            return std::string_view(m_inline, m_length);
+        }
+        return std::string_view(m_external, m_length);
     }
 
-    inline JsonNode& JsonNode::operator[](const std::string& name)
+    inline void JsonNumber::MakeOwned()
     {
-        if (m_type == ValueType::Null)
+        if (m_storage == Storage::Borrowed)
         {
-            m_type = ValueType::Object;
-            m_value = object_type();
+            assign(Text(), false);
         }
-        assert(m_type == ValueType::Object);
-        return std::get<object_type>(m_value)[name];
     }
 
-    inline const JsonNode& JsonNode::operator[](const std::string& name) const
+    inline int64_t JsonNumber::GetInteger() const
     {
-        assert(m_type == ValueType::Object);
-        auto& map = std::get<object_type>(m_value);
-        auto it = map.find(name);
-        if (it == map.end())
+        if (m_cached.load(std::memory_order_acquire))
         {
-            throw std::logic_error("Given key does not exist");
+            return static_cast<int64_t>(m_cache.load(std::memory_order_relaxed));
         }
-        return it->second;
+        auto text = Text();
+        // from_chars does not accept a leading '+', which the lexer allows
+        if (!text.empty() && text[0] == '+')
+        {
+            text.remove_prefix(1);
+        }
+        int64_t value = 0;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (result.ec == std::errc::result_out_of_range)
+        {
+            throw std::out_of_range("Integer out of range: " + std::string(Text()));
+        }
+        m_cache.store(static_cast<uint64_t>(value), std::memory_order_relaxed);
+        m_cached.store(true, std::memory_order_release);
+        return value;
     }
 
-    inline JsonNode& JsonNode::operator[](size_t index)
+    inline double JsonNumber::GetFloat() const
     {
-        assert(m_type == ValueType::Array);
-        return std::get<array_type>(m_value)[index];
+        double value = 0;
+        if (m_cached.load(std::memory_order_acquire))
+        {
+            uint64_t bits = m_cache.load(std::memory_order_relaxed);
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+        value = parse_float();
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        m_cache.store(bits, std::memory_order_relaxed);
+        m_cached.store(true, std::memory_order_release);
+        return value;
     }
 
-    inline const JsonNode& JsonNode::operator[](size_t index) const
+    inline double JsonNumber::IntegerToFloat() const
     {
-        assert(m_type == ValueType::Array);
-        return std::get<array_type>(m_value)[index];
+        return parse_float();
     }
 
-
-    inline std::string JsonNode::internal_tostring(const JsonFormatOption& format, int level) const
+    inline double JsonNumber::parse_float() const
     {
-        auto indent = [&](std::string& str, int L) {
-            if (!format.Inline)
-            {
-                for (int i = 0; i < L + 1; i++)
-                {
-                    if (format.UseTab)
-                    {
-                        str.push_back('\t');
-                    }
-                    else
-                    {
-                        str.append("  ");
-                    }
-                }
-            }
-        };
-        switch (m_type)
+        auto text = Text();
+        if (!text.empty() && text[0] == '+')
         {
-        case SJson::ValueType::Null:
-            return "null";
-        case SJson::ValueType::Object:
+            text.remove_prefix(1);
+        }
+        double value = 0;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (result.ec == std::errc::result_out_of_range)
         {
-            std::string objList = "{";
-            if (!format.Inline)
-            {
-                objList.push_back('\n');
-            }
-            auto& dict = std::get<object_type>(m_value);
-            int count = dict.size();
-            for (auto& node : dict)
+            // Only overflow is an error, a number too small for a denormal rounds to zero
+            if (!below_one(text))
             {
-                indent(objList, level);
-                if (format.KeysWithQuotes)
-                {
-                    objList.push_back('\"');
-                    objList.append(node.first);
-                    objList.push_back('\"');
-                }
-                else
-                {
-                    objList.append(node.first);
-                }
-                objList.append(": ");
-                objList.append(node.second.internal_tostring(format, level + 1));
-                if (--count > 0)
-                {
-                    objList.append(", ");
-                }
-                if (!format.Inline)
-                {
-                    objList.push_back('\n');
-                }
+                throw std::out_of_range("Float out of range: " + std::string(Text()));
             }
-            indent(objList, level - 1);
-            objList.push_back('}');
-            return objList;
+            value = text[0] == '-' ? -0.0 : 0.0;
         }
-        break;
-        case SJson::ValueType::Array:
+        return value;
+    }
+
+    inline bool JsonNumber::below_one(std::string_view text)
+    {
+        // Decimal exponent of the leading significant digit, plus the exponent of the lexeme
+        int64_t magnitude = 0;
+        bool fraction = false;
+        bool significant = false;
+        size_t i = !text.empty() && text[0] == '-' ? 1 : 0;
+        for (; i < text.size() && text[i] != 'e' && text[i] != 'E'; i++)
         {
-            std::string arrayStr = "[";
-            if (!format.Inline)
+            if (text[i] == '.')
             {
-                arrayStr.push_back('\n');
+                fraction = true;
             }
-            auto& dict = std::get<array_type>(m_value);
-            int count = dict.size();
-            for (auto& node : dict)
+            else if (!significant)
             {
-                indent(arrayStr, level);
-                arrayStr.append(node.internal_tostring(format, level + 1));
-                if (--count > 0)
-                {
-                    arrayStr.append(", ");
-                }
-                if (!format.Inline)
-                {
-                    arrayStr.push_back('\n');
-                }
+                magnitude -= fraction ? 1 : 0;
+                significant = text[i] != '0';
+            }
+            else if (!fraction)
+            {
+                magnitude++;
             }
-            indent(arrayStr, level - 1);
-            arrayStr.push_back(']');
-            return arrayStr;
         }
-        break;
-        case SJson::ValueType::String:
+        int64_t exponent = 0;
+        bool negative = i + 1 < text.size() && text[i + 1] == '-';
+        for (i += (i + 1 < text.size() && (text[i + 1] == '-' || text[i + 1] == '+')) ? 2 : 1; i < text.size(); i++)
         {
-            std::string arrayStr = "\"";
-            auto strValue = std::get<std::string>(m_value);
-            arrayStr.append(strValue);
-            arrayStr.push_back('\"');
-            return arrayStr;
+            // Saturate, exponents beyond this are out of range whatever the digits
+            exponent = std::min<int64_t>(exponent * 10 + (text[i] - '0'), 1000000000);
         }
-        break;
-        case SJson::ValueType::Boolean:
+        return magnitude + (negative ? -exponent : exponent) < 0;
+    }
+
+    inline void JsonNumber::assign(std::string_view lexeme, bool borrowed)
+    {
+        m_length = static_cast<uint32_t>(lexeme.size());
+        if (borrowed)
         {
-            auto boolValue = std::get<bool>(m_value);
-            return boolValue ? "true" : "false";
+            m_storage = Storage::Borrowed;
+            m_external = lexeme.data();
         }
-        break;
-        case SJson::ValueType::Integer:
+        else if (lexeme.size() <= INLINE_CAPACITY)
         {
-            auto intValue = std::get<int64_t>(m_value);
-            return std::to_string(intValue);
+            m_storage = Storage::Inline;
+            std::memcpy(m_inline, lexeme.data(), lexeme.size());
         }
-        break;
-        case SJson::ValueType::Float:
+        else
         {
-            // High precision double
-            auto floatValue = std::get<double>(m_value);
-            std::stringstream ss;
-            ss << std::fixed;
-            ss << std::setprecision(std::numeric_limits<double>::digits10 + 2);
-            ss << floatValue;
-            return ss.str();
+            char* buffer = new char[lexeme.size()];
+            std::memcpy(buffer, lexeme.data(), lexeme.size());
+            m_storage = Storage::Heap;
+            m_external = buffer;
         }
-        break;
-        default:
-            break;
+    }
+
+    inline void JsonNumber::release()
+    {
+        if (m_storage == Storage::Heap)
+        {
+            delete[] m_external;
         }
-        return "";
+        m_storage = Storage::Inline;
+        m_length = 0;
     }
 
+    inline JsonObject::JsonObject(std::initializer_list<value_type> list)
+        : m_members(list)
+    {
+        rebuild_index();
+    }
 
-    inline bool is_white_space(const char c)
+    inline JsonObject::JsonObject(const JsonObject& other)
+        : m_members(other.m_members)
     {
-        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        // The index refers to nodes of the other map, so it cannot be copied
+        rebuild_index();
     }
 
-    inline int try_lex_keyword(const std::string& text, int index, const std::string& word)
+    inline JsonObject::JsonObject(JsonObject&& other) noexcept
+        : m_members(std::move(other.m_members)), m_index(std::move(other.m_index))
     {
-        auto len = text.size();
-        auto lenWord = word.size();
-        for (int i = 0; i < lenWord; i++)
+        other.m_index.clear();
+    }
+
+    inline JsonObject& JsonObject::operator=(const JsonObject& other)
+    {
+        if (this != &other)
         {
-            if (index + i >= len || text[index + i] != word[i]) return -1;
+            m_members = other.m_members;
+            rebuild_index();
         }
-        return index + lenWord - 1;
+        return *this;
     }
 
-    inline int lex_remove_whole_line(const std::string& text, int index)
+    inline JsonObject& JsonObject::operator=(JsonObject&& other) noexcept
     {
-        auto len = text.size();
-        int i = index;
-        while (i < len && text[i] != '\n')
+        if (this != &other)
         {
-            i++;
+            m_members = std::move(other.m_members);
+            m_index = std::move(other.m_index);
+            other.m_index.clear();
         }
-        return i;
+        return *this;
     }
 
-    inline int try_lex_string(const std::string& text, int index)
+    inline JsonObject::iterator JsonObject::find(const JsonKey& key)
     {
-        auto len = text.size();
-        int i = index + 1;
-        while (i < len && text[i] != '\"')
+        if (m_index.empty())
         {
-            i++;
+            return m_members.find(key.Name());
         }
-        if (i == len)
+        size_t mask = m_index.size() - 1;
+        for (size_t i = key.Hash() & mask; m_index[i].Hash != 0; i = (i + 1) & mask)
         {
-            //throw parse_error("Unexpected EOF while parsing string", JsonToken{ "", TokenType::String, i, });
-            return -1;
+            if (m_index[i].Hash == key.Hash() && m_index[i].Entry->first == key.Name())
+            {
+                return m_index[i].Entry;
+            }
         }
-        return i;
+        return m_members.end();
     }
 
-
-    struct DFAState
+    inline JsonObject::const_iterator JsonObject::find(const JsonKey& key) const
     {
-        std::string					Name;
-        std::function<int(char c)>	T;
-        bool						Accept;
-    };
+        return const_cast<JsonObject*>(this)->find(key);
+    }
 
-    inline int try_lex_number(const std::string& text, int index, bool& integer)
+    inline std::pair<JsonObject::iterator, bool> JsonObject::try_emplace(std::string name, JsonNode&& value)
     {
-        static std::vector<DFAState> dfa = {
-            DFAState{ "Init",[](char c)
-            {
-                if (isdigit(c)) return 2;
-                else if (c == '+' || c == '-') return 1;
-                else if (c == '.') return 3;
-                return -1;
-            }, false},
-            DFAState{ "Num 0",[](char c)
-            {
-                if (isdigit(c)) return 2;
-                else if (c == '.') return 3;
-                return -1;
-            }, false},
-            DFAState{ "Num 1",[](char c)
-            {
-                if (isdigit(c)) return 2;
-                else if (c == '.') return 4;
-                else if (c == 'e' || c == 'E') return 5;
-                return -1;
-            }, true},
-            DFAState{ "Dot 0",[](char c)
-            {
-                if (isdigit(c)) return 4;
-                return -1;
-            }, false},
-            DFAState{ "Dot 1",[](char c)
-            {
-                if (isdigit(c)) return 4;
-                if (c == 'e' || c == 'E') return 5;
-                return -1;
-            }, true},
-            DFAState{ "Exp 0",[](char c)
-            {
-                if (isdigit(c)) return 7;
-                if (c == '+' || c == '-') return 6;
-                return -1;
-            }, false},
-            DFAState{ "Exp 0.5",[](char c)
-            {
-                if (isdigit(c)) return 7;
-                return -1;
-            }, false},
-            DFAState{ "Exp 1",[](char c)
-            {
-                if (isdigit(c)) return 7;
-                return -1;
-            }, true},
-        };
-
-        auto len = text.size();
-        int dfaPtr = 0;
-        int i = index;
-        integer = true;
-        for (; i < len; i++)
+        auto result = m_members.try_emplace(std::move(name), std::move(value));
+        if (result.second)
         {
-            auto& curState = dfa[dfaPtr];
-            int nxt = curState.T(text[i]);
-            if (nxt == -1)
+            if (!m_index.empty() && m_members.size() * 2 <= m_index.size())
             {
-                if (curState.Accept)
-                {
-                    return i - 1;
-                }
-                else
-                {
-                    return -1;
-                }
+                index_insert(hash_key(result.first->first), result.first);
             }
-            if (nxt == 4 || nxt == 7)
+            else if (m_members.size() >= INDEX_THRESHOLD)
             {
-                integer = false;
+                rebuild_index();
             }
-            dfaPtr = nxt;
         }
-        if (!dfa[dfaPtr].Accept) return -1;
-        return i - 1;
+        return result;
     }
 
-    inline int try_lex(const std::string& text, int index, JsonToken& token)
+    inline JsonObject::size_type JsonObject::erase(std::string_view name)
     {
-        int c = text[index];
-        int newIndex = -1;
-        token.Position = index;
-        switch (c)
-        {
-        case 'n':
+        auto it = m_members.find(name);
+        if (it == m_members.end())
         {
-            if ((newIndex = try_lex_keyword(text, index, "null")) != -1)
-            {
-                token.Value = "";
-                token.Token = TokenType::Null;
-            }
+            return 0;
         }
-        break;
-        case 't':
+        if (!m_index.empty())
         {
-            if ((newIndex = try_lex_keyword(text, index, "true")) != -1)
-            {
-                token.Value = "";
-                token.Token = TokenType::True;
-            }
+            index_erase(hash_key(it->first), it);
         }
-        break;
-        case 'f':
-        {
-            if ((newIndex = try_lex_keyword(text, index, "false")) != -1)
-            {
+        m_members.erase(it);
+        return 1;
+    }
+
+    inline void JsonObject::clear()
+    {
+        m_members.clear();
+        m_index.clear();
+    }
+
+    inline void JsonObject::index_insert(uint64_t hash, iterator entry)
+    {
+        size_t mask = m_index.size() - 1;
+        size_t i = hash & mask;
+        while (m_index[i].Hash != 0)
+        {
+            i = (i + 1) & mask;
+        }
+        m_index[i] = IndexSlot{ hash, entry };
+    }
+
+    inline void JsonObject::index_erase(uint64_t hash, iterator entry)
+    {
+        size_t mask = m_index.size() - 1;
+        size_t i = hash & mask;
+        while (m_index[i].Hash != hash || m_index[i].Entry != entry)
+        {
+            i = (i + 1) & mask;
+        }
+        m_index[i].Hash = 0;
+        // Backward-shift deletion: pull later slots of the probe run into the hole,
+        // unless that would move them before their home slot
+        for (size_t j = (i + 1) & mask; m_index[j].Hash != 0; j = (j + 1) & mask)
+        {
+            size_t home = m_index[j].Hash & mask;
+            if (((j - home) & mask) >= ((j - i) & mask))
+            {
+                m_index[i] = m_index[j];
+                m_index[j].Hash = 0;
+                i = j;
+            }
+        }
+    }
+
+    inline void JsonObject::rebuild_index()
+    {
+        m_index.clear();
+        if (m_members.size() < INDEX_THRESHOLD)
+        {
+            return;
+        }
+        // Keep the load factor at or below 1/2
+        size_t capacity = 1;
+        while (capacity < m_members.size() * 4)
+        {
+            capacity <<= 1;
+        }
+        m_index.resize(capacity, IndexSlot{ 0, m_members.end() });
+        for (auto it = m_members.begin(); it != m_members.end(); ++it)
+        {
+            index_insert(hash_key(it->first), it);
+        }
+    }
+
+    inline JsonNode::JsonNode()
+        : m_type(ValueType::Null), m_value(std::monostate())
+    {
+    }
+
+    template<typename T, t_enable_if_same_type<T, bool>>
+    inline JsonNode::JsonNode(T value)
+        : m_type(ValueType::Boolean), m_value(static_cast<bool>(value))
+    {
+    }
+
+    template<typename T, t_enable_if_integral_type<T>>
+    inline JsonNode::JsonNode(T value)
+        : m_type(ValueType::Integer), m_value(static_cast<int64_t>(value))
+    {
+    }
+
+    template<typename T, t_enable_if_floating_type<T>>
+    inline JsonNode::JsonNode(T value)
+        : m_type(ValueType::Float), m_value(static_cast<std::conditional_t<std::is_same<T, float>::value, float, double>>(value))
+    {
+    }
+
+
+    inline JsonNode::JsonNode(const char* value)
+        : m_type(ValueType::String), m_value(std::string(value))
+    {
+    }
+
+    inline JsonNode::JsonNode(const std::string& value)
+        : m_type(ValueType::String), m_value(value)
+    {
+    }
+
+    inline JsonNode::JsonNode(std::string_view value)
+        : m_type(ValueType::String), m_value(value)
+    {
+    }
+
+    inline JsonNode::JsonNode(JsonNumber&& value, ValueType type)
+        : m_type(type), m_value(std::move(value))
+    {
+    }
+
+    inline JsonNode::JsonNode(int_array_type&& value)
+        : m_type(ValueType::Array), m_value(std::make_shared<int_array_type>(std::move(value)))
+    {
+    }
+
+    inline JsonNode::JsonNode(float_array_type&& value)
+        : m_type(ValueType::Array), m_value(std::make_shared<float_array_type>(std::move(value)))
+    {
+    }
+
+    inline JsonNode::JsonNode(array_type_init list)
+        : m_type(ValueType::Array), m_value(std::make_shared<array_type>(list))
+    {
+    }
+
+    inline JsonNode::JsonNode(object_type_init list)
+        : m_type(ValueType::Object), m_value(std::make_shared<object_type>(list))
+    {
+    }
+
+    //template<typename T>
+    //inline T JsonNode::Get() const
+    //{
+    //	static_assert(false, "Cannot get an un-supportted type");
+    //}
+
+    template<typename T>
+    inline T JsonNode::Get() const
+    {
+        if constexpr (std::is_same<std::decay_t<T>, bool>::value)
+        {
+            assert(m_type == ValueType::Boolean);
+            return std::get<bool>(m_value);
+        }
+        else if constexpr (std::is_integral<std::decay_t<T>>::value && !std::is_same<std::decay_t<T>, bool>::value)
+        {
+            if (IsLazyNumber())
+            {
+                // The cache holds the bits of one type only, so a mismatch must not reach it
+                if (m_type != ValueType::Integer)
+                {
+                    throw std::bad_variant_access();
+                }
+                return static_cast<T>(std::get<JsonNumber>(m_value).GetInteger());
+            }
+            return static_cast<T>(std::get<int64_t>(m_value));
+        }
+        else if constexpr (std::is_floating_point<std::decay_t<T>>::value)
+        {
+            assert(m_type == ValueType::Float || m_type == ValueType::Integer);
+            if (IsLazyNumber())
+            {
+                auto& number = std::get<JsonNumber>(m_value);
+                // Integers are converted on demand, beyond int64_t too
+                return static_cast<T>(m_type == ValueType::Float ? number.GetFloat() : number.IntegerToFloat());
+            }
+            if (auto integer = std::get_if<int64_t>(&m_value))
+            {
+                return static_cast<T>(*integer);
+            }
+            if (auto single = std::get_if<float>(&m_value))
+            {
+                return static_cast<T>(*single);
+            }
+            return static_cast<T>(std::get<double>(m_value));
+        }
+        else
+        {
+            static_assert(false, "Cannot get an un-supportted type");
+        }
+    }
+
+    template<>
+    inline std::string JsonNode::Get() const
+    {
+        assert(m_type == ValueType::String);
+        if (IsBorrowed())
+        {
+            return std::string(std::get<std::string_view>(m_value));
+        }
+        return std::get<std::string>(m_value);
+    }
+
+    template<typename T>
+    inline T JsonNode::Take() &&
+    {
+        if constexpr (std::is_same<std::decay_t<T>, std::string>::value)
+        {
+            assert(m_type == ValueType::String);
+            if (IsBorrowed())
+            {
+                return std::string(std::get<std::string_view>(m_value));
+            }
+            return std::move(std::get<std::string>(m_value));
+        }
+        else if constexpr (std::is_same<std::decay_t<T>, array_type>::value)
+        {
+            assert(m_type == ValueType::Array);
+            return std::move(mutable_array());
+        }
+        else if constexpr (std::is_same<std::decay_t<T>, object_type>::value)
+        {
+            assert(m_type == ValueType::Object);
+            return std::move(*mutable_payload<object_type>());
+        }
+        else
+        {
+            return Get<T>();
+        }
+    }
+
+    inline JsonValue JsonNode::Release() &&
+    {
+        JsonValue value = std::move(m_value);
+        m_type = ValueType::Null;
+        m_exposed = false;
+        m_lent = false;
+        m_value = std::monostate();
+        m_hash.store(0, std::memory_order_relaxed);
+        return value;
+    }
+
+    inline std::string_view JsonNode::GetStringView() const
+    {
+        assert(m_type == ValueType::String);
+        if (IsBorrowed())
+        {
+            return std::get<std::string_view>(m_value);
+        }
+        return std::get<std::string>(m_value);
+    }
+
+    inline std::span<JsonNode> JsonNode::AsArray()
+    {
+        assert(m_type == ValueType::Array);
+        Unpack();
+        return *exposed_payload<array_type>();
+    }
+
+    inline std::span<const JsonNode> JsonNode::AsArray() const
+    {
+        return const_array();
+    }
+
+    inline bool JsonNode::IsPacked() const
+    {
+        return payload<int_array_type>() != nullptr || payload<float_array_type>() != nullptr;
+    }
+
+    template<typename T>
+    inline std::span<const T> JsonNode::GetNumbers() const
+    {
+        static_assert(std::is_same<T, int64_t>::value || std::is_same<T, double>::value,
+            "Packed arrays store either int64_t or double");
+        assert(m_type == ValueType::Array);
+        auto numbers = payload<JsonPackedArray<T>>();
+        if (numbers == nullptr)
+        {
+            throw std::bad_variant_access();
+        }
+        return *numbers;
+    }
+
+    template<typename T>
+    inline void JsonNode::CopyNumbers(std::vector<T>& out) const
+    {
+        assert(m_type == ValueType::Array);
+        auto copy = [&out](const auto& numbers) {
+            size_t offset = out.size();
+            out.resize(offset + numbers.size());
+            for (size_t i = 0; i < numbers.size(); i++)
+            {
+                out[offset + i] = static_cast<T>(numbers[i]);
+            }
+        };
+        if (auto ints = payload<int_array_type>())
+        {
+            copy(*ints);
+        }
+        else if (auto floats = payload<float_array_type>())
+        {
+            copy(*floats);
+        }
+        else
+        {
+            out.reserve(out.size() + Size());
+            for (auto& element : const_array())
+            {
+                out.push_back(element.GetType() == ValueType::Integer
+                    ? static_cast<T>(element.Get<int64_t>()) : static_cast<T>(element.Get<double>()));
+            }
+        }
+    }
+
+    inline void JsonNode::Unpack()
+    {
+        assert(m_type == ValueType::Array);
+        auto unpack = [this](const auto& numbers) {
+            array_type elements;
+            elements.reserve(numbers.size());
+            for (auto number : numbers)
+            {
+                elements.push_back(JsonNode(number));
+            }
+            m_value = std::make_shared<array_type>(std::move(elements));
+        };
+        // The buffer may be shared, so it is read in place and replaced rather than modified
+        if (auto ints = payload<int_array_type>())
+        {
+            unpack(*ints);
+        }
+        else if (auto floats = payload<float_array_type>())
+        {
+            unpack(*floats);
+        }
+    }
+
+    inline size_t JsonNode::Size() const
+    {
+        if (m_type == ValueType::Object)
+        {
+            return AsObject().size();
+        }
+        assert(m_type == ValueType::Array);
+        if (auto ints = payload<int_array_type>())
+        {
+            return ints->size();
+        }
+        if (auto floats = payload<float_array_type>())
+        {
+            return floats->size();
+        }
+        return const_array().size();
+    }
+
+    inline bool JsonNode::IsShared() const
+    {
+        auto shared = [](const auto* value) { return value != nullptr && value->use_count() > 1; };
+        return shared(std::get_if<std::shared_ptr<array_type>>(&m_value))
+            || shared(std::get_if<std::shared_ptr<object_type>>(&m_value))
+            || shared(std::get_if<std::shared_ptr<int_array_type>>(&m_value))
+            || shared(std::get_if<std::shared_ptr<float_array_type>>(&m_value));
+    }
+
+    template<typename T>
+    inline const T* JsonNode::payload() const
+    {
+        auto shared = std::get_if<std::shared_ptr<T>>(&m_value);
+        return shared == nullptr ? nullptr : shared->get();
+    }
+
+    template<typename T>
+    inline T* JsonNode::mutable_payload()
+    {
+        auto shared = std::get_if<std::shared_ptr<T>>(&m_value);
+        if (shared == nullptr)
+        {
+            return nullptr;
+        }
+        // The caller may modify the payload, or keep a reference to modify a member later
+        m_hash.store(0, std::memory_order_relaxed);
+        if (shared->use_count() > 1)
+        {
+            // Detach from the other owners before the payload is modified
+            *shared = std::make_shared<T>(**shared);
+        }
+        else
+        {
+            // Pairs with the release of the reference dropped by the last other owner
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return shared->get();
+    }
+
+    template<typename T>
+    inline T* JsonNode::lent_payload()
+    {
+        auto result = mutable_payload<T>();
+        m_lent = true;
+        return result;
+    }
+
+    template<typename T>
+    inline T* JsonNode::exposed_payload()
+    {
+        auto result = lent_payload<T>();
+        m_exposed = true;
+        return result;
+    }
+
+    inline void JsonNode::clone_payload()
+    {
+        // Elements are copied one by one, so exposed descendants are cloned in turn
+        std::visit([](auto& value) {
+            using V = std::decay_t<decltype(value)>;
+            if constexpr (is_shared_ptr<V>::value)
+            {
+                value = std::make_shared<typename V::element_type>(*value);
+            }
+        }, m_value);
+    }
+
+    inline array_type& JsonNode::mutable_array()
+    {
+        assert(m_type == ValueType::Array);
+        Unpack();
+        return *mutable_payload<array_type>();
+    }
+
+    inline const array_type& JsonNode::const_array() const
+    {
+        assert(m_type == ValueType::Array);
+        if (auto ints = payload<int_array_type>())
+        {
+            return ints->Nodes();
+        }
+        if (auto floats = payload<float_array_type>())
+        {
+            return floats->Nodes();
+        }
+        return *payload<array_type>();
+    }
+
+    template<typename T>
+    inline const array_type& JsonPackedArray<T>::Nodes() const
+    {
+        if (auto nodes = m_published.load(std::memory_order_acquire))
+        {
+            return *nodes;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_nodes == nullptr)
+        {
+            auto nodes = std::make_unique<array_type>();
+            nodes->reserve(this->size());
+            for (auto number : *this)
+            {
+                nodes->push_back(JsonNode(number));
+            }
+            m_nodes = std::move(nodes);
+            m_published.store(m_nodes.get(), std::memory_order_release);
+        }
+        return *m_nodes;
+    }
+
+    template<typename T>
+    inline const JsonNode& JsonPackedArray<T>::Node(size_t index) const
+    {
+        if (auto nodes = m_published.load(std::memory_order_acquire))
+        {
+            return (*nodes)[index];
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_nodes != nullptr)
+        {
+            return (*m_nodes)[index];
+        }
+        if (m_elements == nullptr)
+        {
+            m_elements = std::make_unique<std::unordered_map<size_t, JsonNode>>();
+        }
+        return m_elements->try_emplace(index, (*this)[index]).first->second;
+    }
+
+    template<typename T>
+    inline size_t JsonPackedArray<T>::NodeBytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t bytes = m_nodes == nullptr ? 0 : m_nodes->capacity() * sizeof(JsonNode);
+        if (m_elements != nullptr)
+        {
+            bytes += m_elements->size() * sizeof(std::pair<const size_t, JsonNode>);
+        }
+        return bytes;
+    }
+
+    inline object_type& JsonNode::AsObject()
+    {
+        assert(m_type == ValueType::Object);
+        return *exposed_payload<object_type>();
+    }
+
+    inline const object_type& JsonNode::AsObject() const
+    {
+        assert(m_type == ValueType::Object);
+        return *payload<object_type>();
+    }
+
+    inline std::string& JsonNode::GetMutableString()
+    {
+        assert(m_type == ValueType::String);
+        if (std::holds_alternative<std::string_view>(m_value))
+        {
+            m_value = std::string(std::get<std::string_view>(m_value));
+        }
+        return std::get<std::string>(m_value);
+    }
+
+    inline bool JsonNode::IsBorrowed() const
+    {
+        if (IsLazyNumber())
+        {
+            return std::get<JsonNumber>(m_value).IsBorrowed();
+        }
+        return std::holds_alternative<std::string_view>(m_value);
+    }
+
+    inline std::string_view JsonNode::GetNumberText() const
+    {
+        assert(IsLazyNumber());
+        return std::get<JsonNumber>(m_value).Text();
+    }
+
+    inline void JsonNode::MakeOwned()
+    {
+        switch (m_type)
+        {
+        case SJson::ValueType::String:
+            GetMutableString();
+            break;
+        case SJson::ValueType::Integer:
+        case SJson::ValueType::Float:
+            if (IsLazyNumber())
+            {
+                std::get<JsonNumber>(m_value).MakeOwned();
+            }
+            break;
+        case SJson::ValueType::Array:
+            if (!IsPacked())
+            {
+                for (auto& element : mutable_array())
+                {
+                    element.MakeOwned();
+                }
+            }
+            break;
+        case SJson::ValueType::Object:
+            for (auto& pair : *mutable_payload<object_type>())
+            {
+                pair.second.MakeOwned();
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    struct JsonNode::dedup_table
+    {
+        std::unordered_multimap<uint64_t, JsonValue>	Canonical;	// Payloads that the rest of the tree shares
+        std::unordered_map<const void*, uint64_t>		Hashes;		// Hashes of payloads already in Canonical
+    };
+
+    inline void JsonNode::Deduplicate()
+    {
+        dedup_table table;
+        deduplicate(table);
+    }
+
+    inline const void* JsonNode::payload_address() const
+    {
+        return std::visit([](const auto& value) -> const void* {
+            if constexpr (is_shared_ptr<std::decay_t<decltype(value)>>::value)
+            {
+                return value.get();
+            }
+            else
+            {
+                return nullptr;
+            }
+        }, m_value);
+    }
+
+    inline uint64_t JsonNode::scalar_hash() const
+    {
+        uint64_t hash = hash_combine(14695981039346656037ull, static_cast<uint64_t>(m_type));
+        switch (m_type)
+        {
+        case SJson::ValueType::String:
+            return hash_combine(hash, hash_key(GetStringView()));
+        case SJson::ValueType::Boolean:
+            return hash_combine(hash, std::get<bool>(m_value));
+        case SJson::ValueType::Integer:
+        case SJson::ValueType::Float:
+            if (IsLazyNumber())
+            {
+                return hash_combine(hash, hash_key(GetNumberText()));
+            }
+            if (m_type == ValueType::Integer)
+            {
+                return hash_combine(hash, static_cast<uint64_t>(std::get<int64_t>(m_value)));
+            }
+            {
+                uint64_t bits;
+                double value = Get<double>();
+                std::memcpy(&bits, &value, sizeof(bits));
+                return hash_combine(hash, bits);
+            }
+        default:
+            return hash;
+        }
+    }
+
+    inline uint64_t JsonNode::deduplicate(dedup_table& table)
+    {
+        if (m_type != ValueType::Array && m_type != ValueType::Object)
+        {
+            return scalar_hash();
+        }
+        // A payload met again is already canonical, and accessing it mutably would clone it
+        auto known = table.Hashes.find(payload_address());
+        if (known != table.Hashes.end())
+        {
+            return known->second;
+        }
+
+        // A payload that is already shared, by an earlier Deduplicate or by copies, is
+        // left as it is for the same reason; only this node may still be redirected
+        uint64_t hash = IsShared() ? content_hash(static_cast<const JsonNode&>(*this), table) : content_hash(*this, table);
+        if (m_exposed)
+        {
+            // Sharing would let a held reference modify the other owners
+            return hash;
+        }
+        if (auto canonical = find_canonical(table, hash))
+        {
+            m_value = *canonical;
+            return hash;
+        }
+        table.Canonical.emplace(hash, m_value);
+        table.Hashes.emplace(payload_address(), hash);
+        return hash;
+    }
+
+    inline uint64_t JsonNode::deduplicate(dedup_table& table) const
+    {
+        if (m_type != ValueType::Array && m_type != ValueType::Object)
+        {
+            return scalar_hash();
+        }
+        auto known = table.Hashes.find(payload_address());
+        if (known != table.Hashes.end())
+        {
+            return known->second;
+        }
+
+        // This node lives in a shared payload, so it can only become canonical itself
+        uint64_t hash = content_hash(*this, table);
+        if (!m_exposed && find_canonical(table, hash) == nullptr)
+        {
+            table.Canonical.emplace(hash, m_value);
+            table.Hashes.emplace(payload_address(), hash);
+        }
+        return hash;
+    }
+
+    template<typename Node>
+    inline uint64_t JsonNode::content_hash(Node& node, dedup_table& table)
+    {
+        // Children are deduplicated first, so containers can be compared shallowly.
+        // Through a const node they are only hashed and registered
+        uint64_t hash = hash_combine(node.scalar_hash(), node.Size());
+        if (node.m_type == ValueType::Object)
+        {
+            auto& object = *[&node]() {
+                if constexpr (std::is_const<Node>::value)
+                {
+                    return node.template payload<object_type>();
+                }
+                else
+                {
+                    return node.template mutable_payload<object_type>();
+                }
+            }();
+            for (auto& pair : object)
+            {
+                hash = hash_combine(hash, hash_key(pair.first));
+                hash = hash_combine(hash, pair.second.deduplicate(table));
+            }
+        }
+        else if (auto ints = node.template payload<int_array_type>())
+        {
+            for (auto number : *ints)
+            {
+                hash = hash_combine(hash, static_cast<uint64_t>(number));
+            }
+        }
+        else if (auto floats = node.template payload<float_array_type>())
+        {
+            for (auto number : *floats)
+            {
+                uint64_t bits;
+                std::memcpy(&bits, &number, sizeof(bits));
+                hash = hash_combine(hash, bits);
+            }
+        }
+        else
+        {
+            auto& array = *[&node]() {
+                if constexpr (std::is_const<Node>::value)
+                {
+                    return node.template payload<array_type>();
+                }
+                else
+                {
+                    return node.template mutable_payload<array_type>();
+                }
+            }();
+            for (auto& element : array)
+            {
+                hash = hash_combine(hash, element.deduplicate(table));
+            }
+        }
+        return hash;
+    }
+
+    inline const JsonValue* JsonNode::find_canonical(const dedup_table& table, uint64_t hash) const
+    {
+        auto candidates = table.Canonical.equal_range(hash);
+        for (auto it = candidates.first; it != candidates.second; ++it)
+        {
+            if (same_payload(it->second))
+            {
+                return &it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    inline bool JsonNode::same_payload(const JsonValue& other) const
+    {
+        if (m_value.index() != other.index())
+        {
+            return false;
+        }
+        auto sameNumbers = [](const auto& lhs, const auto& rhs) {
+            // Bitwise, so that 0.0 and -0.0 stay apart
+            return lhs.size() == rhs.size()
+                && std::memcmp(lhs.data(), rhs.data(), lhs.size() * sizeof(lhs[0])) == 0;
+        };
+        if (auto object = std::get_if<std::shared_ptr<object_type>>(&other))
+        {
+            auto& lhs = AsObject();
+            auto& rhs = **object;
+            return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(),
+                [](const auto& a, const auto& b) { return a.first == b.first && identical(a.second, b.second); });
+        }
+        if (auto ints = std::get_if<std::shared_ptr<int_array_type>>(&other))
+        {
+            return sameNumbers(*payload<int_array_type>(), **ints);
+        }
+        if (auto floats = std::get_if<std::shared_ptr<float_array_type>>(&other))
+        {
+            return sameNumbers(*payload<float_array_type>(), **floats);
+        }
+        auto& lhs = const_array();
+        auto& rhs = *std::get<std::shared_ptr<array_type>>(other);
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(), identical);
+    }
+
+    inline uint64_t JsonNode::hash_integer(int64_t value)
+    {
+        return hash_combine(hash_combine(14695981039346656037ull, static_cast<uint64_t>(ValueType::Integer)), value);
+    }
+
+    inline uint64_t JsonNode::hash_float(double value)
+    {
+        // 0.0 == -0.0, so both hash as 0.0
+        uint64_t bits = 0;
+        if (value != 0)
+        {
+            std::memcpy(&bits, &value, sizeof(bits));
+        }
+        return hash_combine(hash_combine(14695981039346656037ull, static_cast<uint64_t>(ValueType::Float)), bits);
+    }
+
+    inline uint64_t JsonNode::Hash() const
+    {
+        bool cacheable = true;
+        return compute_hash(cacheable);
+    }
+
+    inline uint64_t JsonNode::compute_hash(bool& cacheable) const
+    {
+        uint64_t hash = hash_combine(14695981039346656037ull, static_cast<uint64_t>(m_type));
+        switch (m_type)
+        {
+        case SJson::ValueType::String:
+            return hash_combine(hash, hash_key(GetStringView()));
+        case SJson::ValueType::Boolean:
+            return hash_combine(hash, std::get<bool>(m_value));
+        case SJson::ValueType::Integer:
+            if (IsLazyNumber())
+            {
+                try
+                {
+                    return hash_integer(Get<int64_t>());
+                }
+                catch (const std::out_of_range&)
+                {
+                    // Integers beyond int64_t only equal the same text
+                    return hash_combine(hash, hash_key(GetNumberText()));
+                }
+            }
+            return hash_integer(Get<int64_t>());
+        case SJson::ValueType::Float:
+            if (IsLazyNumber())
+            {
+                try
+                {
+                    return hash_float(Get<double>());
+                }
+                catch (const std::out_of_range&)
+                {
+                    // Floats beyond double only equal the same text
+                    return hash_combine(hash, hash_key(GetNumberText()));
+                }
+            }
+            return hash_float(Get<double>());
+        case SJson::ValueType::Object:
+        case SJson::ValueType::Array:
+            break;
+        default:
+            return hash;
+        }
+
+        // A held reference could modify the subtree without clearing the cache
+        auto cached = m_hash.load(std::memory_order_relaxed);
+        if (cached != 0 && !m_lent)
+        {
+            return cached;
+        }
+        bool cacheableChildren = true;
+        hash = hash_combine(hash, Size());
+        if (m_type == ValueType::Object)
+        {
+            for (auto& pair : AsObject())
+            {
+                hash = hash_combine(hash, hash_key(pair.first));
+                hash = hash_combine(hash, pair.second.compute_hash(cacheableChildren));
+            }
+        }
+        else if (auto ints = payload<int_array_type>())
+        {
+            for (auto number : *ints)
+            {
+                hash = hash_combine(hash, hash_integer(number));
+            }
+        }
+        else if (auto floats = payload<float_array_type>())
+        {
+            for (auto number : *floats)
+            {
+                hash = hash_combine(hash, hash_float(number));
+            }
+        }
+        else
+        {
+            for (auto& element : const_array())
+            {
+                hash = hash_combine(hash, element.compute_hash(cacheableChildren));
+            }
+        }
+        hash = hash == 0 ? 1 : hash;
+        if (cacheableChildren && !m_lent)
+        {
+            m_hash.store(hash, std::memory_order_relaxed);
+        }
+        cacheable = cacheable && cacheableChildren && !m_lent;
+        return hash;
+    }
+
+    inline JsonMemoryUsage JsonNode::MemoryUsage() const
+    {
+        JsonMemoryUsage usage;
+        std::unordered_set<const void*> visited;
+        usage.Nodes += sizeof(JsonNode);
+        memory_usage(usage, visited);
+        return usage;
+    }
+
+    inline void JsonNode::memory_usage(JsonMemoryUsage& usage, std::unordered_set<const void*>& visited) const
+    {
+        // Short strings live inside the std::string object
+        auto stringHeap = [](const std::string& str) -> size_t {
+            auto data = reinterpret_cast<const char*>(str.data());
+            auto self = reinterpret_cast<const char*>(&str);
+            return data >= self && data < self + sizeof(str) ? 0 : str.capacity() + 1;
+        };
+        // Payloads are allocated together with their shared_ptr control block
+        constexpr size_t controlBlock = 2 * sizeof(void*) + 2 * sizeof(uint32_t);
+
+        if (m_type == ValueType::String)
+        {
+            if (auto str = std::get_if<std::string>(&m_value))
+            {
+                auto heap = stringHeap(*str);
+                usage.Strings += heap == 0 ? 0 : str->size() + 1;
+                usage.Slack += heap == 0 ? 0 : heap - str->size() - 1;
+            }
+            return;
+        }
+        if (IsLazyNumber())
+        {
+            usage.Strings += std::get<JsonNumber>(m_value).HeapSize();
+            return;
+        }
+        if (m_type != ValueType::Array && m_type != ValueType::Object)
+        {
+            return;
+        }
+        if (!visited.insert(payload_address()).second)
+        {
+            return;
+        }
+
+        if (auto object = payload<object_type>())
+        {
+            // Each member is a red-black tree node: color, parent, left and right links, then the pair
+            constexpr size_t treeLinks = 4 * sizeof(void*);
+            usage.Containers += controlBlock + sizeof(object_type) + object->size() * treeLinks
+                + object->IndexBytes();
+            for (auto& pair : *object)
+            {
+                usage.Keys += sizeof(std::string) + stringHeap(pair.first);
+                usage.Nodes += sizeof(JsonNode);
+                pair.second.memory_usage(usage, visited);
+            }
+        }
+        else if (auto array = payload<array_type>())
+        {
+            usage.Containers += controlBlock + sizeof(array_type);
+            usage.Nodes += array->size() * sizeof(JsonNode);
+            usage.Slack += (array->capacity() - array->size()) * sizeof(JsonNode);
+            for (auto& element : *array)
+            {
+                element.memory_usage(usage, visited);
+            }
+        }
+        else
+        {
+            auto count = [&](const auto& numbers) {
+                usage.Containers += controlBlock + sizeof(numbers);
+                usage.Packed += numbers.size() * sizeof(numbers[0]);
+                usage.Nodes += numbers.NodeBytes();
+                usage.Slack += (numbers.capacity() - numbers.size()) * sizeof(numbers[0]);
+            };
+            if (auto ints = payload<int_array_type>())
+            {
+                count(*ints);
+            }
+            else
+            {
+                count(*payload<float_array_type>());
+            }
+        }
+    }
+
+    template<typename F>
+    inline void JsonNode::visit_element(size_t index, F&& action) const
+    {
+        if (auto ints = payload<int_array_type>())
+        {
+            action(JsonNode((*ints)[index]));
+        }
+        else if (auto floats = payload<float_array_type>())
+        {
+            action(JsonNode((*floats)[index]));
+        }
+        else
+        {
+            action(const_array()[index]);
+        }
+    }
+
+    inline bool JsonNode::number_equal(const JsonNode& other) const
+    {
+        if (IsLazyNumber() && other.IsLazyNumber() && GetNumberText() == other.GetNumberText())
+        {
+            return true;
+        }
+        try
+        {
+            if (m_type == ValueType::Float)
+            {
+                return Get<double>() == other.Get<double>();
+            }
+            return Get<int64_t>() == other.Get<int64_t>();
+        }
+        catch (const std::out_of_range&)
+        {
+            return false;
+        }
+    }
+
+    inline bool JsonNode::operator==(const JsonNode& other) const
+    {
+        if (m_type != other.m_type)
+        {
+            return false;
+        }
+        switch (m_type)
+        {
+        case SJson::ValueType::String:
+            return GetStringView() == other.GetStringView();
+        case SJson::ValueType::Boolean:
+            return std::get<bool>(m_value) == std::get<bool>(other.m_value);
+        case SJson::ValueType::Integer:
+        case SJson::ValueType::Float:
+            return number_equal(other);
+        case SJson::ValueType::Object:
+        case SJson::ValueType::Array:
+            break;
+        default:
+            return true;
+        }
+
+        if (payload_address() == other.payload_address())
+        {
+            return true;
+        }
+        if (Size() != other.Size())
+        {
+            return false;
+        }
+        auto hash = m_lent ? 0 : m_hash.load(std::memory_order_relaxed);
+        auto otherHash = other.m_lent ? 0 : other.m_hash.load(std::memory_order_relaxed);
+        if (hash != 0 && otherHash != 0 && hash != otherHash)
+        {
+            return false;
+        }
+
+        if (m_type == ValueType::Object)
+        {
+            auto& lhs = AsObject();
+            auto& rhs = other.AsObject();
+            return std::equal(lhs.begin(), lhs.end(), rhs.begin(),
+                [](const auto& a, const auto& b) { return a.first == b.first && a.second == b.second; });
+        }
+        auto ints = payload<int_array_type>();
+        auto otherInts = other.payload<int_array_type>();
+        if (ints != nullptr && otherInts != nullptr)
+        {
+            return *ints == *otherInts;
+        }
+        auto floats = payload<float_array_type>();
+        auto otherFloats = other.payload<float_array_type>();
+        if (floats != nullptr && otherFloats != nullptr)
+        {
+            return *floats == *otherFloats;
+        }
+        for (size_t i = 0; i < Size(); i++)
+        {
+            bool equal = false;
+            visit_element(i, [&](const JsonNode& lhs) {
+                other.visit_element(i, [&](const JsonNode& rhs) { equal = lhs == rhs; });
+            });
+            if (!equal)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    inline bool JsonNode::identical(const JsonNode& lhs, const JsonNode& rhs)
+    {
+        if (lhs.m_type != rhs.m_type || lhs.m_value.index() != rhs.m_value.index())
+        {
+            return false;
+        }
+        return std::visit([&rhs](const auto& value) {
+            using V = std::decay_t<decltype(value)>;
+            const auto& other = std::get<V>(rhs.m_value);
+            if constexpr (is_shared_ptr<V>::value)
+            {
+                // Both sides are canonical already
+                return value == other;
+            }
+            else if constexpr (std::is_same<V, JsonNumber>::value)
+            {
+                return value.Text() == other.Text();
+            }
+            else if constexpr (std::is_floating_point<V>::value)
+            {
+                return std::memcmp(&value, &other, sizeof(V)) == 0;
+            }
+            else
+            {
+                return value == other;
+            }
+        }, lhs.m_value);
+    }
+
+
+    inline std::string JsonNode::ToString(const JsonFormatOption& format) const
+    {
+        JsonWriter writer(format);
+        if (format.PreMeasure)
+        {
+            writer.Reserve(SerializedSize(format));
+        }
+        Write(writer);
+        return writer.Take();
+    }
+
+    inline std::string JsonNode::ToCanonical() const
+    {
+        return ToString(CanonicalOption);
+    }
+
+    inline uint64_t JsonNode::CanonicalHash() const
+    {
+        JsonHashSink sink;
+        JsonWriter writer(sink, CanonicalOption);
+        Write(writer);
+        writer.Flush();
+        return sink.Hash();
+    }
+
+    inline size_t JsonNode::SerializedSize(const JsonFormatOption& format) const
+    {
+        auto writer = JsonWriter::Measure(format);
+        Write(writer);
+        return writer.Size();
+    }
+
+    inline void JsonNode::WriteTo(JsonSink& sink, const JsonFormatOption& format) const
+    {
+        JsonWriter writer(sink, format);
+        Write(writer);
+        writer.Flush();
+    }
+
+    template<typename F>
+    inline void JsonNode::foreach(F&& action) const
+    {
+        for (auto& element : *this)
+        {
+            action(element);
+        }
+    }
+
+    template<typename F>
+    inline void JsonNode::foreach_pairs(F&& action) const
+    {
+        for (auto& pair : items())
+        {
+            action(pair.first, pair.second);
+        }
+    }
+
+    inline JsonNode* JsonNode::begin()
+    {
+        return AsArray().data();
+    }
+
+    inline JsonNode* JsonNode::end()
+    {
+        auto arr = AsArray();
+        return arr.data() + arr.size();
+    }
+
+    inline const JsonNode* JsonNode::begin() const
+    {
+        assert(m_type == ValueType::Array);
+        return const_array().data();
+    }
+
+    inline const JsonNode* JsonNode::end() const
+    {
+        assert(m_type == ValueType::Array);
+        auto& arr = const_array();
+        return arr.data() + arr.size();
+    }
+
+    inline iterator_range<object_type::iterator> JsonNode::items()
+    {
+        auto& map = AsObject();
+        return { map.begin(), map.end() };
+    }
+
+    inline iterator_range<object_type::const_iterator> JsonNode::items() const
+    {
+        auto& map = AsObject();
+        return { map.begin(), map.end() };
+    }
+
+    inline void JsonNode::push_back(JsonNode&& node)
+    {
+        mutable_array().push_back(std::move(node));
+    }
+
+    inline void JsonNode::push_back(const JsonNode& node)
+    {
+        mutable_array().push_back(node);
+    }
+
+    inline JsonNode* JsonNode::Find(std::string_view name)
+    {
+        if (m_type != ValueType::Object)
+        {
+            return nullptr;
+        }
+        auto& map = AsObject();
+        auto it = map.find(name);
+        return it == map.end() ? nullptr : &it->second;
+    }
+
+    inline const JsonNode* JsonNode::Find(std::string_view name) const
+    {
+        if (m_type != ValueType::Object)
+        {
+            return nullptr;
+        }
+        auto& map = AsObject();
+        auto it = map.find(name);
+        return it == map.end() ? nullptr : &it->second;
+    }
+
+    inline JsonNode& JsonNode::operator[](std::string_view name)
+    {
+        if (m_type == ValueType::Null)
+        {
+            m_type = ValueType::Object;
+            m_value = std::make_shared<object_type>();
+        }
+        assert(m_type == ValueType::Object);
+        auto& map = *lent_payload<object_type>();
+        auto it = map.find(name);
+        if (it == map.end())
+        {
+            // Only a missing key needs to be materialized as a std::string
+            it = map.try_emplace(std::string(name), JsonNode()).first;
+        }
+        return it->second;
+    }
+
+    inline JsonNode* JsonNode::Find(const JsonKey& key)
+    {
+        if (m_type != ValueType::Object)
+        {
+            return nullptr;
+        }
+        auto& map = AsObject();
+        auto it = map.find(key);
+        return it == map.end() ? nullptr : &it->second;
+    }
+
+    inline const JsonNode* JsonNode::Find(const JsonKey& key) const
+    {
+        if (m_type != ValueType::Object)
+        {
+            return nullptr;
+        }
+        auto& map = AsObject();
+        auto it = map.find(key);
+        return it == map.end() ? nullptr : &it->second;
+    }
+
+    inline JsonNode& JsonNode::operator[](const JsonKey& key)
+    {
+        if (m_type == ValueType::Null)
+        {
+            m_type = ValueType::Object;
+            m_value = std::make_shared<object_type>();
+        }
+        assert(m_type == ValueType::Object);
+        auto& map = *lent_payload<object_type>();
+        auto it = map.find(key);
+        if (it == map.end())
+        {
+            it = map.try_emplace(std::string(key.Name()), JsonNode()).first;
+        }
+        return it->second;
+    }
+
+    inline const JsonNode& JsonNode::operator[](const JsonKey& key) const
+    {
+        assert(m_type == ValueType::Object);
+        auto member = Find(key);
+        if (member == nullptr)
+        {
+            throw std::logic_error("Given key does not exist");
+        }
+        return *member;
+    }
+
+    inline const JsonNode& JsonNode::operator[](std::string_view name) const
+    {
+        assert(m_type == ValueType::Object);
+        auto member = Find(name);
+        if (member == nullptr)
+        {
+            throw std::logic_error("Given key does not exist");
+        }
+        return *member;
+    }
+
+    inline JsonNode& JsonNode::operator[](size_t index)
+    {
+        assert(m_type == ValueType::Array);
+        Unpack();
+        return (*lent_payload<array_type>())[index];
+    }
+
+    inline const JsonNode& JsonNode::operator[](size_t index) const
+    {
+        assert(m_type == ValueType::Array);
+        if (auto ints = payload<int_array_type>())
+        {
+            return ints->Node(index);
+        }
+        if (auto floats = payload<float_array_type>())
+        {
+            return floats->Node(index);
+        }
+        return (*payload<array_type>())[index];
+    }
+
+
+    /**
+     * @brief Find the first character that has to be escaped in a JSON string
+     * @param begin
+     * @param end
+     * @param nonAscii True if bytes beyond ASCII have to be escaped as well
+     * @return end if the whole range can be copied as it is
+    */
+    inline const char* find_escape(const char* begin, const char* end, bool nonAscii)
+    {
+        auto needsEscape = [nonAscii](char c) {
+            auto byte = static_cast<uint8_t>(c);
+            return byte < 0x20 || c == '\"' || c == '\\' || (nonAscii && byte >= 0x80);
+        };
+#ifdef SJSON_SSE2
+        // Test 16 bytes at a time, so that clean runs cost one branch per block
+        const __m128i quote = _mm_set1_epi8('\"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i lastControl = _mm_set1_epi8(0x1F);
+        for (; end - begin >= 16; begin += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            __m128i special = _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash));
+            // Unsigned block <= 0x1F
+            special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(block, lastControl), block));
+            int mask = _mm_movemask_epi8(special);
+            if (nonAscii)
+            {
+                mask |= _mm_movemask_epi8(block);
+            }
+            if (mask != 0)
+            {
+                for (int i = 0; i < 16; i++)
+                {
+                    if (mask & (1 << i))
+                    {
+                        return begin + i;
+                    }
+                }
+            }
+        }
+#endif
+        for (; begin != end; begin++)
+        {
+            if (needsEscape(*begin))
+            {
+                return begin;
+            }
+        }
+        return end;
+    }
+
+    /**
+     * @brief Decode one UTF-8 sequence
+     * @param text Advanced past the sequence
+     * @param end
+     * @return The code point, or U+FFFD for a malformed sequence, of which one byte is consumed
+    */
+    inline uint32_t decode_utf8(const char*& text, const char* end)
+    {
+        auto lead = static_cast<uint8_t>(*text);
+        int length = lead >= 0xF0 && lead < 0xF8 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC2 && lead < 0xE0 ? 2 : 0;
+        if (length == 0 || end - text < length)
+        {
+            text++;
+            return 0xFFFD;
+        }
+        uint32_t codePoint = lead & (0x7F >> length);
+        for (int i = 1; i < length; i++)
+        {
+            auto next = static_cast<uint8_t>(text[i]);
+            if ((next & 0xC0) != 0x80)
+            {
+                text++;
+                return 0xFFFD;
+            }
+            codePoint = (codePoint << 6) | (next & 0x3F);
+        }
+        constexpr uint32_t smallest[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        if (codePoint < smallest[length] || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint < 0xE000))
+        {
+            text++;
+            return 0xFFFD;
+        }
+        text += length;
+        return codePoint;
+    }
+
+    inline void append_utf8(std::string& out, uint32_t codePoint)
+    {
+        if (codePoint < 0x80)
+        {
+            out.push_back(static_cast<char>(codePoint));
+        }
+        else if (codePoint < 0x800)
+        {
+            out.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else if (codePoint < 0x10000)
+        {
+            out.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else
+        {
+            out.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+    }
+
+    /**
+     * @brief Order of strings by their UTF-16 code units, as RFC 8785 sorts object keys.
+     * Differs from byte order only between characters above U+FFFF and U+E000 to U+FFFF
+     * @param lhs
+     * @param rhs
+     * @return
+    */
+    inline bool utf16_less(std::string_view lhs, std::string_view rhs)
+    {
+        auto next = [](const char*& text, const char* end) -> uint32_t {
+            auto byte = static_cast<uint8_t>(*text);
+            return byte < 0x80 ? (text++, byte) : decode_utf8(text, end);
+        };
+        // Characters above U+FFFF start with a high surrogate, which sorts below U+E000
+        auto unit = [](uint32_t codePoint) -> uint32_t {
+            return codePoint >= 0x10000 ? 0xD800 | ((codePoint - 0x10000) >> 10) : codePoint;
+        };
+        auto l = lhs.data(), lend = l + lhs.size();
+        auto r = rhs.data(), rend = r + rhs.size();
+        while (l != lend && r != rend)
+        {
+            auto lc = next(l, lend);
+            auto rc = next(r, rend);
+            if (lc != rc)
+            {
+                return unit(lc) != unit(rc) ? unit(lc) < unit(rc) : lc < rc;
+            }
+        }
+        return l == lend && r != rend;
+    }
+
+    /**
+     * @brief Stands in for the output string of append_escaped, only counting characters
+    */
+    struct counting_output
+    {
+        size_t Size = 0;
+
+        void append(const char* begin, const char* end) { Size += end - begin; }
+        void append(const char*, size_t size) { Size += size; }
+        void append(const char* text) { Size += std::strlen(text); }
+        void push_back(char) { Size++; }
+    };
+
+    /**
+     * @brief Append the characters of text escaped for a JSON string, without the quotes
+     * @param out
+     * @param text
+     * @param nonAscii True if characters beyond ASCII are written as \uXXXX (surrogate pairs above U+FFFF)
+    */
+    template<typename Out>
+    inline void append_escaped(Out& out, std::string_view text, bool nonAscii)
+    {
+        constexpr char hex[] = "0123456789abcdef";
+        auto appendUnit = [&out, &hex](uint32_t unit) {
+            char escaped[6] = { '\\', 'u', hex[(unit >> 12) & 0xF], hex[(unit >> 8) & 0xF], hex[(unit >> 4) & 0xF], hex[unit & 0xF] };
+            out.append(escaped, sizeof(escaped));
+        };
+        auto begin = text.data();
+        auto end = begin + text.size();
+        while (begin != end)
+        {
+            auto special = find_escape(begin, end, nonAscii);
+            out.append(begin, special);
+            if (special == end)
+            {
+                break;
+            }
+            begin = special + 1;
+            switch (*special)
+            {
+            case '\"': out.append("\\\""); break;
+            case '\\': out.append("\\\\"); break;
+            case '\n': out.append("\\n"); break;
+            case '\r': out.append("\\r"); break;
+            case '\t': out.append("\\t"); break;
+            case '\b': out.append("\\b"); break;
+            case '\f': out.append("\\f"); break;
+            default:
+                if (static_cast<uint8_t>(*special) < 0x20)
+                {
+                    appendUnit(static_cast<uint8_t>(*special));
+                }
+                else
+                {
+                    begin = special;
+                    auto codePoint = decode_utf8(begin, end);
+                    if (codePoint >= 0x10000)
+                    {
+                        codePoint -= 0x10000;
+                        appendUnit(0xD800 | (codePoint >> 10));
+                        appendUnit(0xDC00 | (codePoint & 0x3FF));
+                    }
+                    else
+                    {
+                        appendUnit(codePoint);
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    inline void JsonStreamSink::Write(std::string_view data)
+    {
+        if (!m_stream.write(data.data(), data.size()))
+        {
+            throw std::runtime_error("Failed to write JSON to stream");
+        }
+    }
+
+    inline void JsonStreamSink::Flush()
+    {
+        if (!m_stream.flush())
+        {
+            throw std::runtime_error("Failed to flush JSON stream");
+        }
+    }
+
+    inline void JsonFileSink::Write(std::string_view data)
+    {
+        if (std::fwrite(data.data(), 1, data.size(), m_file) != data.size())
+        {
+            throw std::system_error(errno, std::generic_category(), "Failed to write JSON to file");
+        }
+    }
+
+    inline void JsonFileSink::Flush()
+    {
+        if (std::fflush(m_file) != 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "Failed to flush JSON file");
+        }
+    }
+
+    inline void JsonHashSink::Write(std::string_view data)
+    {
+        for (char c : data)
+        {
+            m_hash ^= static_cast<uint8_t>(c);
+            m_hash *= 1099511628211ull;
+        }
+    }
+
+    inline void JsonBufferSink::Write(std::string_view data)
+    {
+        if (data.size() > m_capacity - m_size)
+        {
+            throw std::length_error("JSON text does not fit in the buffer");
+        }
+        std::memcpy(m_data + m_size, data.data(), data.size());
+        m_size += data.size();
+    }
+
+    inline JsonFdSink::~JsonFdSink()
+    {
+        try
+        {
+            Flush();
+        }
+        catch (const std::system_error&)
+        {
+        }
+    }
+
+    inline void JsonFdSink::Write(std::string_view data)
+    {
+        if (m_size + data.size() > BUFFER_SIZE)
+        {
+            Flush();
+        }
+        if (data.size() >= BUFFER_SIZE)
+        {
+            // Large chunks gain nothing from a copy through the buffer
+            write_fd(data.data(), data.size());
+            return;
+        }
+        std::memcpy(m_buffer + m_size, data.data(), data.size());
+        m_size += data.size();
+    }
+
+    inline void JsonFdSink::Flush()
+    {
+        size_t size = m_size;
+        m_size = 0;
+        write_fd(m_buffer, size);
+    }
+
+    inline void JsonFdSink::write_fd(const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+#ifdef _WIN32
+            auto written = _write(m_fd, data, static_cast<unsigned int>(std::min<size_t>(size, std::numeric_limits<int>::max())));
+#else
+            auto written = ::write(m_fd, data, size);
+#endif
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Failed to write JSON to file descriptor");
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    inline JsonWriter::JsonWriter(const JsonFormatOption& format)
+        : m_format(format), m_sink(nullptr), m_measure(false), m_size(0),
+        m_maxThreads(format.MaxThreads == 0 ? std::thread::hardware_concurrency() : format.MaxThreads)
+    {
+        if (m_format.Canonical)
+        {
+            m_format.Minify = true;
+            m_format.KeysWithQuotes = true;
+            m_format.EscapeNonAscii = false;
+        }
+        if (m_format.Minify)
+        {
+            m_format.Inline = true;
+        }
+    }
+
+    inline JsonWriter::JsonWriter(JsonSink& sink, const JsonFormatOption& format)
+        : JsonWriter(format)
+    {
+        m_sink = &sink;
+        m_buffer.reserve(SINK_CHUNK_SIZE);
+    }
+
+    inline JsonWriter::JsonWriter(const JsonWriter& parent, size_t index)
+        : m_format(parent.m_format), m_indent(parent.m_indent), m_scopes(parent.m_scopes), m_sink(nullptr), m_measure(parent.m_measure), m_size(0), m_maxThreads(1)
+    {
+        // Continue the enclosing scope as if the elements before index were already written
+        m_scopes.back().Count = index;
+    }
+
+    template<typename It, typename F>
+    inline void JsonWriter::WriteRange(It begin, It end, F&& write)
+    {
+        assert(!m_scopes.empty());
+        size_t threads = m_maxThreads;
+        size_t count = 0;
+        if (threads >= 2)
+        {
+            count = static_cast<size_t>(std::distance(begin, end));
+            threads = std::min(threads, count / PARALLEL_MIN_CHUNK);
+        }
+        if (threads < 2)
+        {
+            for (; begin != end; ++begin)
+            {
+                write(*this, *begin);
+            }
+            return;
+        }
+
+        // Chunk boundaries are found in one pass, so that map iterators are walked only once
+        size_t chunkCount = threads * PARALLEL_WAVE_CHUNKS;
+        size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+        std::vector<It> bounds{ begin };
+        for (size_t remaining = count; remaining > 0;)
+        {
+            auto size = std::min(chunkSize, remaining);
+            begin = std::next(begin, size);
+            bounds.push_back(begin);
+            remaining -= size;
+        }
+
+        // Workers only read the scopes of this template, while this writer appends the chunks
+        const JsonWriter parent(*this, m_scopes.back().Count);
+        std::vector<std::optional<JsonWriter>> chunks(bounds.size() - 1);
+        std::mutex mutex;
+        std::condition_variable changed;
+        size_t next = 0;
+        size_t appended = 0;
+        size_t pending = 0;
+        std::exception_ptr error;
+        auto work = [&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                // Stay at most one chunk per thread ahead of the text appended so far
+                changed.wait(lock, [&]() { return error || next == chunks.size() || next < appended + threads; });
+                if (error || next == chunks.size())
+                {
+                    return;
+                }
+                size_t index = next++;
+                lock.unlock();
+                try
+                {
+                    JsonWriter chunk(parent, parent.m_scopes.back().Count + index * chunkSize);
+                    for (auto it = bounds[index]; it != bounds[index + 1]; ++it)
+                    {
+                        write(chunk, *it);
+                    }
+                    lock.lock();
+                    chunks[index].emplace(std::move(chunk));
+                }
+                catch (...)
+                {
+                    if (!lock.owns_lock())
+                    {
+                        lock.lock();
+                    }
+                    error = error ? error : std::current_exception();
+                }
+                changed.notify_all();
+            }
+        };
+
+        // Queues every task or none, so a failure here leaves nothing referencing this frame
+        auto& pool = JsonWorkerPool::Instance();
+        pool.Run(work, threads, pending);
+        try
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (appended < chunks.size())
+            {
+                changed.wait(lock, [&]() { return error || chunks[appended].has_value(); });
+                if (error)
+                {
+                    break;
+                }
+                auto chunk = std::move(*chunks[appended]);
+                chunks[appended].reset();
+                lock.unlock();
+                append_chunk(chunk);
+                lock.lock();
+                appended++;
+                changed.notify_all();
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = error ? error : std::current_exception();
+            changed.notify_all();
+        }
+        pool.Wait(pending);
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    inline void JsonWriter::append_chunk(const JsonWriter& chunk)
+    {
+        m_size += chunk.m_size;
+        if (!m_measure)
+        {
+            m_buffer.append(chunk.m_buffer);
+        }
+        m_scopes.back().Count = chunk.m_scopes.back().Count;
+        flush_if_full();
+    }
+
+    inline JsonWriter JsonWriter::Measure(const JsonFormatOption& format)
+    {
+        JsonWriter writer(format);
+        writer.m_measure = true;
+        return writer;
+    }
+
+    inline void JsonWriter::put(char c)
+    {
+        m_size++;
+        if (!m_measure)
+        {
+            m_buffer.push_back(c);
+        }
+    }
+
+    inline void JsonWriter::put(std::string_view text)
+    {
+        m_size += text.size();
+        if (!m_measure)
+        {
+            m_buffer.append(text);
+        }
+    }
+
+    inline void JsonWriter::Flush()
+    {
+        if (m_sink != nullptr)
+        {
+            if (!m_buffer.empty())
+            {
+                m_sink->Write(m_buffer);
+                m_buffer.clear();
+            }
+            m_sink->Flush();
+        }
+    }
+
+    inline void JsonWriter::flush_if_full()
+    {
+        if (m_sink != nullptr && m_buffer.size() >= SINK_CHUNK_SIZE)
+        {
+            m_sink->Write(m_buffer);
+            m_buffer.clear();
+        }
+    }
+
+    inline void JsonWriter::indent(size_t depth)
+    {
+        size_t width = m_format.UseTab ? 1 : m_format.IndentWidth;
+        if (m_indent.size() < depth * width)
+        {
+            m_indent.resize(depth * width, m_format.UseTab ? '\t' : ' ');
+        }
+        put(std::string_view(m_indent.data(), depth * width));
+    }
+
+    inline bool JsonWriter::breaks_lines() const
+    {
+        return !m_format.Inline && !m_scopes.back().SingleLine;
+    }
+
+    inline void JsonWriter::separate()
+    {
+        flush_if_full();
+        auto& scope = m_scopes.back();
+        if (scope.Count++ > 0)
+        {
+            put(m_format.Minify ? "," : ", ");
+            if (breaks_lines())
+            {
+                put('\n');
+            }
+        }
+        if (breaks_lines())
+        {
+            indent(m_scopes.size());
+        }
+    }
+
+    inline void JsonWriter::start_value()
+    {
+        // Members of objects are separated by Key
+        if (!m_scopes.empty() && !m_scopes.back().IsObject)
+        {
+            separate();
+        }
+    }
+
+    inline void JsonWriter::start_scope(char open, bool isObject, bool singleLine)
+    {
+        start_value();
+        put(open);
+        m_scopes.push_back({ isObject, 0, singleLine || (!m_scopes.empty() && m_scopes.back().SingleLine) });
+        if (breaks_lines())
+        {
+            put('\n');
+        }
+    }
+
+    inline void JsonWriter::end_scope(char close)
+    {
+        assert(!m_scopes.empty());
+        flush_if_full();
+        bool breaks = breaks_lines();
+        if (m_scopes.back().Count > 0 && breaks)
+        {
+            put('\n');
+        }
+        m_scopes.pop_back();
+        if (breaks)
+        {
+            indent(m_scopes.size());
+        }
+        put(close);
+    }
+
+    inline void JsonWriter::StartObject()
+    {
+        start_scope('{', true);
+    }
+
+    inline void JsonWriter::EndObject()
+    {
+        assert(m_scopes.back().IsObject);
+        end_scope('}');
+    }
+
+    inline void JsonWriter::StartArray()
+    {
+        start_scope('[', false);
+    }
+
+    inline void JsonWriter::StartArray(size_t length, bool scalars)
+    {
+        start_scope('[', false, scalars && length > 0 && length <= m_format.ShortArrayLength);
+    }
+
+    inline void JsonWriter::EndArray()
+    {
+        assert(!m_scopes.back().IsObject);
+        end_scope(']');
+    }
+
+    inline void JsonWriter::Key(std::string_view name)
+    {
+        assert(!m_scopes.empty() && m_scopes.back().IsObject);
+        separate();
+        if (m_format.KeysWithQuotes)
+        {
+            put('\"');
+            write_escaped(name);
+            put('\"');
+        }
+        else
+        {
+            write_escaped(name);
+        }
+        put(m_format.Minify ? ":" : ": ");
+    }
+
+    inline void JsonWriter::Key(const JsonKeyLiteral& key)
+    {
+        assert(!m_scopes.empty() && m_scopes.back().IsObject);
+        separate();
+        auto text = m_format.KeysWithQuotes ? key.Quoted : key.Unquoted;
+        if (m_format.Minify)
+        {
+            // Drop the space after the colon
+            text.remove_suffix(1);
+        }
+        put(text);
+    }
+
+    template<typename T>
+    inline void JsonWriter::Value(const T& value)
+    {
+        start_value();
+        if constexpr (std::is_same<T, bool>::value)
+        {
+            put(value ? "true" : "false");
+        }
+        else if constexpr (std::is_integral<T>::value)
+        {
+            if (m_format.Canonical)
+            {
+                write_canonical_number(static_cast<double>(value));
+                return;
+            }
+            char digits[24];
+            auto result = std::to_chars(digits, digits + sizeof(digits), static_cast<int64_t>(value));
+            put(std::string_view(digits, result.ptr - digits));
+        }
+        else if constexpr (std::is_same<T, float>::value)
+        {
+            write_float(value);
+        }
+        else if constexpr (std::is_floating_point<T>::value)
+        {
+            write_float(static_cast<double>(value));
+        }
+        else
+        {
+            static_assert(std::is_convertible<const T&, std::string_view>::value, "Not a JSON value");
+            put('\"');
+            write_escaped(std::string_view(value));
+            put('\"');
+        }
+    }
+
+    inline void JsonWriter::Null()
+    {
+        start_value();
+        put("null");
+    }
+
+    inline void JsonWriter::RawValue(std::string_view text)
+    {
+        start_value();
+        put(text);
+    }
+
+    inline void JsonWriter::write_escaped(std::string_view text)
+    {
+        if (m_measure)
+        {
+            counting_output counter;
+            append_escaped(counter, text, m_format.EscapeNonAscii);
+            m_size += counter.Size;
+        }
+        else
+        {
+            auto before = m_buffer.size();
+            append_escaped(m_buffer, text, m_format.EscapeNonAscii);
+            m_size += m_buffer.size() - before;
+        }
+    }
+
+    template<typename T>
+    inline void JsonWriter::write_float(T value)
+    {
+        if (!std::isfinite(value))
+        {
+            // JSON has no infinity or NaN
+            put("null");
+            return;
+        }
+        if (m_format.Canonical)
+        {
+            write_canonical_number(static_cast<double>(value));
+            return;
+        }
+        // Shortest text that parses back to the same value, in fixed or scientific notation
+        char digits[32];
+        auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        put(std::string_view(digits, end - digits));
+        if (std::find_if(digits, end, [](char c) { return c == '.' || c == 'e'; }) == end)
+        {
+            // Keep integral values floats when they are parsed again
+            put(".0");
+        }
+    }
+
+    inline void JsonWriter::write_canonical_number(double value)
+    {
+        // Number::toString of ECMAScript, as RFC 8785 requires
+        if (!std::isfinite(value))
+        {
+            put("null");
+            return;
+        }
+        if (value == 0)
+        {
+            put('0');
+            return;
+        }
+        if (value < 0)
+        {
+            put('-');
+            value = -value;
+        }
+        char text[32];
+        auto end = std::to_chars(text, text + sizeof(text), value, std::chars_format::scientific).ptr;
+        auto e = std::find(text, end, 'e');
+        int exponent = 0;
+        std::from_chars(e + (e[1] == '+' ? 2 : 1), end, exponent);
+        // Shortest digits d1 d2 ... dk, with value = 0.d1d2...dk * 10^n
+        char digits[20];
+        int k = 0;
+        for (auto c = text; c != e; c++)
+        {
+            if (*c != '.')
+            {
+                digits[k++] = *c;
+            }
+        }
+        int n = exponent + 1;
+        if (k <= n && n <= 21)
+        {
+            put(std::string_view(digits, k));
+            for (int i = k; i < n; i++)
+            {
+                put('0');
+            }
+        }
+        else if (0 < n && n <= 21)
+        {
+            put(std::string_view(digits, n));
+            put('.');
+            put(std::string_view(digits + n, k - n));
+        }
+        else if (-6 < n && n <= 0)
+        {
+            put("0.");
+            for (int i = n; i < 0; i++)
+            {
+                put('0');
+            }
+            put(std::string_view(digits, k));
+        }
+        else
+        {
+            put(digits[0]);
+            if (k > 1)
+            {
+                put('.');
+                put(std::string_view(digits + 1, k - 1));
+            }
+            put(n - 1 < 0 ? "e-" : "e+");
+            char power[8];
+            auto powerEnd = std::to_chars(power, power + sizeof(power), n - 1 < 0 ? 1 - n : n - 1).ptr;
+            put(std::string_view(power, powerEnd - power));
+        }
+    }
+
+    inline void JsonNode::Write(JsonWriter& writer) const
+    {
+        switch (m_type)
+        {
+        case SJson::ValueType::Null:
+            writer.Null();
+            break;
+        case SJson::ValueType::Object:
+            writer.StartObject();
+            if (writer.Format().Canonical && !std::all_of(AsObject().begin(), AsObject().end(), [](const auto& pair) {
+                // Below U+E000 the byte order of the map is also the UTF-16 order
+                return std::all_of(pair.first.begin(), pair.first.end(), [](char c) { return static_cast<uint8_t>(c) < 0xEE; });
+            }))
+            {
+                std::vector<const object_type::value_type*> members;
+                members.reserve(AsObject().size());
+                for (auto& pair : AsObject())
+                {
+                    members.push_back(&pair);
+                }
+                std::sort(members.begin(), members.end(), [](auto lhs, auto rhs) { return utf16_less(lhs->first, rhs->first); });
+                writer.WriteRange(members.begin(), members.end(), [](JsonWriter& writer, const object_type::value_type* pair) {
+                    writer.Key(pair->first);
+                    pair->second.Write(writer);
+                });
+            }
+            else
+            {
+                writer.WriteRange(AsObject().begin(), AsObject().end(), [](JsonWriter& writer, const auto& pair) {
+                    writer.Key(pair.first);
+                    pair.second.Write(writer);
+                });
+            }
+            writer.EndObject();
+            break;
+        case SJson::ValueType::Array:
+            if (auto ints = payload<int_array_type>())
+            {
+                writer.StartArray(ints->size(), true);
+                writer.WriteRange(ints->begin(), ints->end(), [](JsonWriter& writer, int64_t number) { writer.Value(number); });
+            }
+            else if (auto floats = payload<float_array_type>())
+            {
+                writer.StartArray(floats->size(), true);
+                writer.WriteRange(floats->begin(), floats->end(), [](JsonWriter& writer, double number) { writer.Value(number); });
+            }
+            else
+            {
+                auto& elements = const_array();
+                bool scalars = elements.size() <= writer.Format().ShortArrayLength && std::all_of(elements.begin(), elements.end(), [](const JsonNode& element) {
+                    return element.m_type != ValueType::Array && element.m_type != ValueType::Object;
+                });
+                writer.StartArray(elements.size(), scalars);
+                writer.WriteRange(elements.begin(), elements.end(), [](JsonWriter& writer, const JsonNode& element) { element.Write(writer); });
+            }
+            writer.EndArray();
+            break;
+        case SJson::ValueType::String:
+            writer.Value(GetStringView());
+            break;
+        case SJson::ValueType::Boolean:
+            writer.Value(std::get<bool>(m_value));
+            break;
+        case SJson::ValueType::Integer:
+        case SJson::ValueType::Float:
+            if (IsLazyNumber() && writer.Format().Canonical)
+            {
+                writer.Value(Get<double>());
+            }
+            else if (IsLazyNumber())
+            {
+                writer.RawValue(GetNumberText());
+            }
+            else if (m_type == ValueType::Integer)
+            {
+                writer.Value(std::get<int64_t>(m_value));
+            }
+            else if (auto single = std::get_if<float>(&m_value))
+            {
+                writer.Value(*single);
+            }
+            else
+            {
+                writer.Value(std::get<double>(m_value));
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+
+    inline bool is_white_space(const char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    inline int try_lex_keyword(std::string_view text, int index, std::string_view word)
+    {
+        auto len = text.size();
+        auto lenWord = word.size();
+        for (int i = 0; i < lenWord; i++)
+        {
+            if (index + i >= len || text[index + i] != word[i]) return -1;
+        }
+        return index + lenWord - 1;
+    }
+
+    inline int lex_remove_whole_line(std::string_view text, int index)
+    {
+        auto len = text.size();
+        int i = index;
+        while (i < len && text[i] != '\n')
+        {
+            i++;
+        }
+        return i;
+    }
+
+    inline int try_lex_string(std::string_view text, int index)
+    {
+        auto len = text.size();
+        int i = index + 1;
+        while (i < len && text[i] != '\"')
+        {
+            // An escaped character, possibly a quote, never ends the string
+            i += text[i] == '\\' ? 2 : 1;
+        }
+        if (i >= len)
+        {
+            //throw parse_error("Unexpected EOF while parsing string", JsonToken{ "", TokenType::String, i, });
+            return -1;
+        }
+        return i;
+    }
+
+
+    struct DFAState
+    {
+        std::string					Name;
+        std::function<int(char c)>	T;
+        bool						Accept;
+    };
+
+    inline int try_lex_number(std::string_view text, int index, bool& integer)
+    {
+        static std::vector<DFAState> dfa = {
+            DFAState{ "Init",[](char c)
+            {
+                if (isdigit(c)) return 2;
+                else if (c == '+' || c == '-') return 1;
+                else if (c == '.') return 3;
+                return -1;
+            }, false},
+            DFAState{ "Num 0",[](char c)
+            {
+                if (isdigit(c)) return 2;
+                else if (c == '.') return 3;
+                return -1;
+            }, false},
+            DFAState{ "Num 1",[](char c)
+            {
+                if (isdigit(c)) return 2;
+                else if (c == '.') return 4;
+                else if (c == 'e' || c == 'E') return 5;
+                return -1;
+            }, true},
+            DFAState{ "Dot 0",[](char c)
+            {
+                if (isdigit(c)) return 4;
+                return -1;
+            }, false},
+            DFAState{ "Dot 1",[](char c)
+            {
+                if (isdigit(c)) return 4;
+                if (c == 'e' || c == 'E') return 5;
+                return -1;
+            }, true},
+            DFAState{ "Exp 0",[](char c)
+            {
+                if (isdigit(c)) return 7;
+                if (c == '+' || c == '-') return 6;
+                return -1;
+            }, false},
+            DFAState{ "Exp 0.5",[](char c)
+            {
+                if (isdigit(c)) return 7;
+                return -1;
+            }, false},
+            DFAState{ "Exp 1",[](char c)
+            {
+                if (isdigit(c)) return 7;
+                return -1;
+            }, true},
+        };
+
+        auto len = text.size();
+        int dfaPtr = 0;
+        int i = index;
+        integer = true;
+        for (; i < len; i++)
+        {
+            auto& curState = dfa[dfaPtr];
+            int nxt = curState.T(text[i]);
+            if (nxt == -1)
+            {
+                if (curState.Accept)
+                {
+                    return i - 1;
+                }
+                else
+                {
+                    return -1;
+                }
+            }
+            if (nxt == 4 || nxt == 7)
+            {
+                integer = false;
+            }
+            dfaPtr = nxt;
+        }
+        if (!dfa[dfaPtr].Accept) return -1;
+        return i - 1;
+    }
+
+    /**
+     * @brief Whether a lexeme accepted by try_lex_number is also a number of RFC 8259,
+     * which has no leading '+' or zeros and digits on both sides of the '.'
+     * @param text
+     * @return
+    */
+    inline bool is_strict_number(std::string_view text)
+    {
+        size_t i = 0;
+        auto digits = [&text, &i]() {
+            size_t start = i;
+            while (i < text.size() && text[i] >= '0' && text[i] <= '9')
+            {
+                i++;
+            }
+            return i - start;
+        };
+        if (i < text.size() && text[i] == '-')
+        {
+            i++;
+        }
+        size_t start = i;
+        size_t integral = digits();
+        if (integral == 0 || (integral > 1 && text[start] == '0'))
+        {
+            return false;
+        }
+        if (i < text.size() && text[i] == '.')
+        {
+            i++;
+            if (digits() == 0)
+            {
+                return false;
+            }
+        }
+        if (i < text.size() && (text[i] == 'e' || text[i] == 'E'))
+        {
+            i++;
+            if (i < text.size() && (text[i] == '+' || text[i] == '-'))
+            {
+                i++;
+            }
+            if (digits() == 0)
+            {
+                return false;
+            }
+        }
+        return i == text.size();
+    }
+
+    inline int try_lex(std::string_view text, int index, JsonToken& token)
+    {
+        int c = text[index];
+        int newIndex = -1;
+        token.Position = index;
+        switch (c)
+        {
+        case 'n':
+        {
+            if ((newIndex = try_lex_keyword(text, index, "null")) != -1)
+            {
+                token.Value = "";
+                token.Token = TokenType::Null;
+            }
+        }
+        break;
+        case 't':
+        {
+            if ((newIndex = try_lex_keyword(text, index, "true")) != -1)
+            {
+                token.Value = "";
+                token.Token = TokenType::True;
+            }
+        }
+        break;
+        case 'f':
+        {
+            if ((newIndex = try_lex_keyword(text, index, "false")) != -1)
+            {
                 token.Value = "";
                 token.Token = TokenType::False;
             }
         }
-        break;
-        case '{':
+        break;
+        case '{':
+        {
+            newIndex = index;
+            token.Value = text.substr(index, 1);
+            token.Token = TokenType::LeftBrace;
+        }
+        break;
+        case '}':
+        {
+            newIndex = index;
+            token.Value = text.substr(index, 1);
+            token.Token = TokenType::RightBrace;
+        }
+        break;
+        case '[':
+        {
+            newIndex = index;
+            token.Value = text.substr(index, 1);
+            token.Token = TokenType::LeftBracket;
+        }
+        break;
+        case ']':
+        {
+            newIndex = index;
+            token.Value = text.substr(index, 1);
+            token.Token = TokenType::RightBracket;
+        }
+        break;
+        case ',':
+        {
+            newIndex = index;
+            token.Value = text.substr(index, 1);
+            token.Token = TokenType::Comma;
+        }
+        break;
+        case ':':
+        {
+            newIndex = index;
+            token.Value = text.substr(index, 1);
+            token.Token = TokenType::Colon;
+        }
+        break;
+        case '#':
+        {
+            newIndex = lex_remove_whole_line(text, index);
+            token.Value = text.substr(index, 1);
+            token.Token = TokenType::Comment;
+        }
+        break;
+        case '\"':
+        {
+            if ((newIndex = try_lex_string(text, index)) != -1)
+            {
+                token.Value = text.substr(index + 1, newIndex - index - 1);
+                token.Token = TokenType::String;
+            }
+        }
+        break;
+        default:
+        {
+            bool integer;
+            if ((newIndex = try_lex_number(text, index, integer)) != -1)
+            {
+                token.Value = text.substr(index, newIndex - index + 1);
+                token.Token = integer ? TokenType::Integer : TokenType::Float;
+            }
+        }
+        break;
+        }
+        return newIndex;
+    }
+
+    inline std::vector<JsonToken> lex(std::string_view text)
+    {
+        std::vector<JsonToken> tokenList;
+        int length = text.size();
+        for (int i = 0; i < length; i++)
+        {
+            if (is_white_space(text[i]))
+            {
+                continue;
+            }
+            if (i == length) break;
+            JsonToken token;
+            int newIndex = try_lex(text, i, token);
+            if (newIndex != -1)
+            {
+                i = newIndex;
+                if (token.Token == TokenType::Comment)
+                {
+                    continue;
+                }
+                else
+                {
+                    token.OriginalText = text;
+                    tokenList.push_back(token);
+                }
+            }
+            else
+            {
+                throw lexical_error(JsonToken{ "", TokenType::Unknown, i, text });
+            }
+        }
+        tokenList.push_back(JsonToken{ "", TokenType::EndOfFile, length, text });
+        return tokenList;
+    }
+
+    inline int expect(const JsonToken& token, TokenType type, int index)
+    {
+        if (token.Token != type)
+        {
+            throw expect_token_error(type, token.Token, token);
+        }
+        return index + 1;
+    }
+
+    inline std::string remove_escapes(std::string_view str, const JsonToken& token)
+    {
+        std::string result;
+        int len = str.size();
+        for (int i = 0; i < len; i++)
+        {
+            if (str[i] != '\\')
+            {
+                result.push_back(str[i]);
+                continue;
+            }
+            if (str[i] == '\\')
+            {
+                if (i == len - 1)
+                {
+                    throw invalid_escape_char(token);
+                }
+                switch (str[i + 1])
+                {
+                case 'n':
+                    result.push_back('\n');
+                    i++;
+                    break;
+                case 'r':
+                    result.push_back('\r');
+                    i++;
+                    break;
+                case 't':
+                    result.push_back('\t');
+                    i++;
+                    break;
+                case '\\':
+                case '\"':
+                case '/':
+                    result.push_back(str[i + 1]);
+                    i++;
+                    break;
+                case 'b':
+                    result.push_back('\b');
+                    i++;
+                    break;
+                case 'f':
+                    result.push_back('\f');
+                    i++;
+                    break;
+                case 'u':
+                {
+                    auto unit = [&](int at) {
+                        uint32_t value = 0;
+                        if (at + 4 > len || std::from_chars(str.data() + at, str.data() + at + 4, value, 16).ptr != str.data() + at + 4)
+                        {
+                            throw invalid_escape_char(token);
+                        }
+                        return value;
+                    };
+                    uint32_t codePoint = unit(i + 2);
+                    i += 5;
+                    if (codePoint >= 0xD800 && codePoint < 0xDC00)
+                    {
+                        // A high surrogate has to be followed by an escaped low surrogate
+                        if (i + 2 >= len || str[i + 1] != '\\' || str[i + 2] != 'u')
+                        {
+                            throw invalid_escape_char(token);
+                        }
+                        uint32_t low = unit(i + 3);
+                        if (low < 0xDC00 || low >= 0xE000)
+                        {
+                            throw invalid_escape_char(token);
+                        }
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    }
+                    else if (codePoint >= 0xDC00 && codePoint < 0xE000)
+                    {
+                        throw invalid_escape_char(token);
+                    }
+                    append_utf8(result, codePoint);
+                    break;
+                }
+                default:
+                    throw invalid_escape_char(token);
+                    break;
+                }
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Parse the members of an object, moving every value into place as it is parsed
+     * @param tokens
+     * @param index Index of the first token after '{'
+     * @param newIndex
+     * @param option
+     * @return
+    */
+    inline object_type parse_object(const std::vector<JsonToken>& tokens,
+        int index, int& newIndex, const JsonParseOption& option)
+    {
+        object_type list;
+        int curIndex = index;
+        if (tokens[curIndex].Token != TokenType::RightBrace)
+        {
+            while (true)
+            {
+                auto& keyToken = tokens[curIndex++];
+                if (keyToken.Token == TokenType::EndOfFile)
+                {
+                    throw invalid_eof(keyToken);
+                }
+                if (keyToken.Token != TokenType::String)
+                {
+                    throw keys_not_string(keyToken);
+                }
+
+                curIndex = expect(tokens[curIndex], TokenType::Colon, curIndex);
+                int nxtIndex;
+                auto value = parse(tokens, curIndex, nxtIndex, option);
+                curIndex = nxtIndex;
+
+                auto result = list.try_emplace(keyToken.Value.find('\\') == std::string_view::npos
+                    ? std::string(keyToken.Value) : remove_escapes(keyToken.Value, keyToken), std::move(value));
+                if (!result.second)
+                {
+                    // The last of duplicated keys wins
+                    result.first->second = std::move(value);
+                }
+
+                if (tokens[curIndex].Token == TokenType::Comma)
+                {
+                    curIndex++;
+                }
+                else
+                {
+                    break;
+                }
+            }
+            newIndex = expect(tokens[curIndex], TokenType::RightBrace, curIndex);
+            return list;
+        }
+        else
         {
-            newIndex = index;
-            token.Value = c;
-            token.Token = TokenType::LeftBrace;
+            newIndex = index + 1;
+            return list;
         }
-        break;
-        case '}':
+    }
+
+    inline array_type parse_array(const std::vector<JsonToken>& tokens,
+        int index, int& newIndex, const JsonParseOption& option)
+    {
+        array_type list;
+        int curIndex = index;
+        if (tokens[curIndex].Token != TokenType::RightBracket)
         {
-            newIndex = index;
-            token.Value = c;
-            token.Token = TokenType::RightBrace;
+            while (true)
+            {
+                int nxtIndex;
+                list.push_back(parse(tokens, curIndex, nxtIndex, option));
+                curIndex = nxtIndex;
+                if (tokens[curIndex].Token == TokenType::Comma)
+                {
+                    curIndex++;
+                }
+                else
+                {
+                    break;
+                }
+            }
+            newIndex = expect(tokens[curIndex], TokenType::RightBracket, curIndex);
+            return list;
         }
-        break;
-        case '[':
+        else
         {
-            newIndex = index;
-            token.Value = c;
-            token.Token = TokenType::LeftBracket;
+            newIndex = index + 1;
+            return list;
         }
-        break;
-        case ']':
+    }
+
+    /**
+     * @brief Parse an array whose elements are all eager numbers directly into a contiguous buffer
+     * @param tokens
+     * @param index Index of the first token after '['
+     * @param newIndex
+     * @param node Receives the packed array
+     * @return False (consuming nothing) if the array contains anything but numbers
+    */
+    inline bool try_parse_packed_array(const std::vector<JsonToken>& tokens, int index, int& newIndex, JsonNode& node)
+    {
+        // Scan first, so that arrays which cannot be packed cost no conversion
+        bool allIntegers = true;
+        bool allFloats = true;
+        int curIndex = index;
+        while (true)
         {
-            newIndex = index;
-            token.Value = c;
-            token.Token = TokenType::RightBracket;
+            auto type = tokens[curIndex].Token;
+            if (type != TokenType::Integer && type != TokenType::Float)
+            {
+                return false;
+            }
+            allIntegers = allIntegers && type == TokenType::Integer;
+            allFloats = allFloats && type == TokenType::Float;
+            if (tokens[curIndex + 1].Token == TokenType::Comma)
+            {
+                curIndex += 2;
+            }
+            else if (tokens[curIndex + 1].Token == TokenType::RightBracket)
+            {
+                break;
+            }
+            else
+            {
+                return false;
+            }
         }
-        break;
-        case ',':
+        if (!allIntegers && !allFloats)
         {
-            newIndex = index;
-            token.Value = c;
-            token.Token = TokenType::Comma;
+            // Mixed arrays keep their element types as nodes
+            return false;
         }
-        break;
-        case ':':
+        size_t count = (curIndex - index) / 2 + 1;
+        if (allIntegers)
+        {
+            int_array_type numbers;
+            numbers.reserve(count);
+            for (int i = index; i <= curIndex; i += 2)
+            {
+                numbers.push_back(std::stoll(std::string(tokens[i].Value), nullptr, 10));
+            }
+            node = JsonNode(std::move(numbers));
+        }
+        else
+        {
+            float_array_type numbers;
+            numbers.reserve(count);
+            for (int i = index; i <= curIndex; i += 2)
+            {
+                numbers.push_back(std::stod(std::string(tokens[i].Value), nullptr));
+            }
+            node = JsonNode(std::move(numbers));
+        }
+        newIndex = curIndex + 2;
+        return true;
+    }
+
+    inline JsonNode parse(const std::vector<JsonToken>& tokens, int index, int& newIndex, const JsonParseOption& option)
+    {
+        auto& token = tokens[index];
+        switch (token.Token)
+        {
+        case TokenType::Null:
+        {
+            newIndex = index + 1;
+            return JsonNode();
+        }
+        case TokenType::Integer:
+        {
+            newIndex = index + 1;
+            // Other lexemes are converted now, so that the text written back is valid JSON
+            if (option.LazyNumbers && is_strict_number(token.Value))
+            {
+                return JsonNode(JsonNumber(token.Value, option.BorrowStrings), ValueType::Integer);
+            }
+            return JsonNode(std::stoll(std::string(token.Value), nullptr, 10));
+        }
+        case TokenType::Float:
+        {
+            newIndex = index + 1;
+            if (option.LazyNumbers && is_strict_number(token.Value))
+            {
+                return JsonNode(JsonNumber(token.Value, option.BorrowStrings), ValueType::Float);
+            }
+            return JsonNode(std::stod(std::string(token.Value), nullptr));
+        }
+        case TokenType::True:
+        {
+            newIndex = index + 1;
+            return JsonNode(true);
+        }
+        case TokenType::False:
+        {
+            newIndex = index + 1;
+            return JsonNode(false);
+        }
+        case TokenType::String:
+        {
+            newIndex = index + 1;
+            // Strings without escapes are exactly the source characters, so they can be borrowed
+            if (option.BorrowStrings && token.Value.find('\\') == std::string_view::npos)
+            {
+                return borrow(token.Value);
+            }
+            return JsonNode(remove_escapes(token.Value, token));
+        }
+        case TokenType::LeftBrace:
+        {
+            JsonNode node = JsonNode(object_type_init());
+            *node.mutable_payload<object_type>() = parse_object(tokens, index + 1, newIndex, option);
+            return node;
+        }
+        case TokenType::LeftBracket:
+        {
+            JsonNode node;
+            // Lazy numbers promise exact text, so only eager numbers are packed
+            if (option.PackNumericArrays && !option.LazyNumbers
+                && try_parse_packed_array(tokens, index + 1, newIndex, node))
+            {
+                return node;
+            }
+            node = JsonNode(array_type_init());
+            *node.mutable_payload<array_type>() = parse_array(tokens, index + 1, newIndex, option);
+            return node;
+        }
+        case TokenType::EndOfFile:
+        {
+            throw invalid_eof(token);
+        }
+        default:
+            break;
+        }
+        throw parse_match_failed(token);
+    }
+
+    inline JsonNode JsonConvert::Parse(const std::string& text)
+    {
+        return Parse(text, DefaultParseOption);
+    }
+
+    inline JsonNode JsonConvert::Parse(const char* text, const JsonParseOption& option)
+    {
+        return Parse(std::string_view(text), option);
+    }
+
+    inline JsonNode JsonConvert::Parse(std::string_view text, const JsonParseOption& option)
+    {
+        auto tokens = lex(text);
+        int index = 0;
+        auto node = parse(tokens, 0, index, option);
+        if (tokens[index].Token != TokenType::EndOfFile)
+        {
+            throw root_not_singular_error(tokens[index]);
+        }
+        if (option.Deduplicate)
+        {
+            node.Deduplicate();
+        }
+        return node;
+    }
+
+    inline JsonDocument::JsonDocument(std::string text, const JsonParseOption& option)
+        : m_text(std::make_unique<std::string>(std::move(text)))
+    {
+        m_root = JsonConvert::Parse(*m_text, option);
+    }
+
+    inline JsonMemoryUsage JsonDocument::MemoryUsage() const
+    {
+        auto usage = m_root.MemoryUsage();
+        usage.Text += sizeof(std::string) + m_text->capacity() + 1;
+        return usage;
+    }
+
+    template<typename T>
+    inline JsonSnapshot<T>::ReadGuard::ReadGuard(ReadGuard&& other) noexcept
+        : m_readers(other.m_readers), m_value(other.m_value)
+    {
+        other.m_readers = nullptr;
+        other.m_value = nullptr;
+    }
+
+    template<typename T>
+    inline JsonSnapshot<T>::ReadGuard::~ReadGuard()
+    {
+        if (m_readers != nullptr)
+        {
+            m_readers->fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    template<typename T>
+    inline JsonSnapshot<T>::JsonSnapshot(T value)
+        : m_current(new T(std::move(value))), m_epoch(0)
+    {
+    }
+
+    template<typename T>
+    inline JsonSnapshot<T>::~JsonSnapshot()
+    {
+        delete m_current.load(std::memory_order_acquire);
+    }
+
+    template<typename T>
+    inline typename JsonSnapshot<T>::ReadGuard JsonSnapshot<T>::Read() const
+    {
+        auto& readers = m_readers[m_epoch.load(std::memory_order_acquire) & 1].Count;
+        // Both operations are sequentially consistent: a reader that registers after a
+        // publisher found its slot empty is guaranteed to load the new pointer
+        readers.fetch_add(1, std::memory_order_seq_cst);
+        return ReadGuard(&readers, m_current.load(std::memory_order_seq_cst));
+    }
+
+    template<typename T>
+    inline void JsonSnapshot<T>::Publish(T value)
+    {
+        auto next = new T(std::move(value));
+        std::lock_guard<std::mutex> lock(m_publish);
+        auto previous = m_current.exchange(next, std::memory_order_seq_cst);
+        for (int i = 0; i < 2; i++)
+        {
+            auto epoch = m_epoch.fetch_add(1, std::memory_order_seq_cst);
+            auto& readers = m_readers[epoch & 1].Count;
+            while (readers.load(std::memory_order_seq_cst) != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        // Seeing a drained slot synchronizes with the release in ~ReadGuard of its last reader
+        delete previous;
+    }
+
+    inline JsonReclaimer& JsonReclaimer::Instance()
+    {
+        static JsonReclaimer reclaimer;
+        return reclaimer;
+    }
+
+    inline JsonReclaimer::JsonReclaimer()
+        : m_busy(false), m_stop(false)
+    {
+        m_thread = std::thread(&JsonReclaimer::run, this);
+    }
+
+    inline JsonReclaimer::~JsonReclaimer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+    }
+
+    inline void JsonReclaimer::Release(std::shared_ptr<void> value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.push_back(std::move(value));
+        }
+        m_wake.notify_one();
+    }
+
+    inline void JsonReclaimer::Flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return m_pending.empty() && !m_busy; });
+    }
+
+    inline void JsonReclaimer::run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_wake.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+            if (m_pending.empty())
+            {
+                // Stopping, everything released has been destroyed
+                return;
+            }
+            auto batch = std::move(m_pending);
+            m_pending.clear();
+            m_busy = true;
+            lock.unlock();
+            batch.clear();
+            lock.lock();
+            m_busy = false;
+            if (m_pending.empty())
+            {
+                m_idle.notify_all();
+            }
+        }
+    }
+
+    inline JsonWorkerPool& JsonWorkerPool::Instance()
+    {
+        static JsonWorkerPool pool;
+        return pool;
+    }
+
+    inline JsonWorkerPool::JsonWorkerPool()
+        : m_idle(0), m_stop(false)
+    {
+    }
+
+    inline JsonWorkerPool::~JsonWorkerPool()
+    {
         {
-            newIndex = index;
-            token.Value = c;
-            token.Token = TokenType::Colon;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
         }
-        break;
-        case '#':
+        m_wake.notify_all();
+        for (auto& thread : m_threads)
         {
-            newIndex = lex_remove_whole_line(text, index);
-            token.Value = c;
-            token.Token = TokenType::Comment;
+            thread.join();
         }
-        break;
-        case '\"':
+    }
+
+    inline void JsonWorkerPool::Run(const std::function<void()>& task, size_t count, size_t& pending)
+    {
         {
-            if ((newIndex = try_lex_string(text, index)) != -1)
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // A task may wait for its caller, so no task waits for a thread busy with another
+            while (m_idle < m_tasks.size() + count)
             {
-                token.Value = text.substr(index + 1, newIndex - index - 1);
-                token.Token = TokenType::String;
+                m_threads.emplace_back(&JsonWorkerPool::run, this);
+                m_idle++;
             }
-        }
-        break;
-        default:
-        {
-            bool integer;
-            if ((newIndex = try_lex_number(text, index, integer)) != -1)
+            pending = count;
+            for (size_t i = 0; i < count; i++)
             {
-                token.Value = text.substr(index, newIndex - index + 1);
-                token.Token = integer ? TokenType::Integer : TokenType::Float;
+                m_tasks.emplace_back(task, &pending);
             }
         }
-        break;
-        }
-        return newIndex;
+        m_wake.notify_all();
     }
 
-    inline std::vector<JsonToken> lex(const std::string& text)
+    inline void JsonWorkerPool::Wait(const size_t& pending)
     {
-        std::vector<JsonToken> tokenList;
-        auto originalText = std::make_shared<std::string>(text);
-        int length = text.size();
-        for (int i = 0; i < length; i++)
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [&pending]() { return pending == 0; });
+    }
+
+    inline size_t JsonWorkerPool::Size()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_threads.size();
+    }
+
+    inline void JsonWorkerPool::run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
         {
-            if (is_white_space(text[i]))
-            {
-                continue;
-            }
-            if (i == length) break;
-            JsonToken token;
-            int newIndex = try_lex(text, i, token);
-            if (newIndex != -1)
+            m_wake.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+            if (m_tasks.empty())
             {
-                i = newIndex;
-                if (token.Token == TokenType::Comment)
-                {
-                    continue;
-                }
-                else
-                {
-                    token.OriginalText = originalText;
-                    tokenList.push_back(token);
-                }
+                return;
             }
-            else
+            auto task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            m_idle--;
+            lock.unlock();
+            task.first();
+            task.first = nullptr;
+            lock.lock();
+            // Counted free together with the end of the run, so a caller that waited never sees it busy
+            m_idle++;
+            if (--*task.second == 0)
             {
-                throw lexical_error(JsonToken{ "", TokenType::Unknown, i, originalText });
+                m_done.notify_all();
             }
         }
-        tokenList.push_back(JsonToken{ "", TokenType::EndOfFile, length, originalText });
-        return tokenList;
     }
 
-    inline int expect(const JsonToken& token, TokenType type, int index)
+    template<typename T>
+    inline void DeferredRelease(T&& value)
     {
-        if (token.Token != type)
-        {
-            throw expect_token_error(type, token.Token, token);
-        }
-        return index + 1;
+        static_assert(!std::is_lvalue_reference<T>::value, "DeferredRelease takes ownership, pass an rvalue");
+        JsonReclaimer::Instance().Release(std::make_shared<std::decay_t<T>>(std::move(value)));
     }
 
-    using maplist = std::vector<std::pair<const std::string, JsonNode>>;
-    using m_pair = std::pair<const std::string, JsonNode>;
-    using arrlist = std::vector<JsonNode>;
+    //
+    // Tape document
+    // 只读文档
+    //
 
-    inline maplist parse_object(const std::vector<JsonToken>& tokens,
-        int index, int& newIndex)
+    /**
+     * @brief Immutable document stored as a flat array of 64-bit tape words plus one
+     * string buffer. Every value is a word with the value type in the top 8 bits;
+     * numbers keep their raw 64 bits in the following word, strings point into the
+     * string buffer, and containers store the index just past their matching close
+     * word so that whole subtrees can be skipped in O(1).
+    */
+    class JsonTape
     {
+    public:
+        static JsonTape Parse(std::string_view text);
 
-        maplist list;
-        int curIndex = index;
-        if (tokens[curIndex].Token != TokenType::RightBrace)
+        JsonElement Root() const;
+    private:
+        friend class JsonElement;
+
+        static constexpr uint64_t TAG_SHIFT = 56;
+        static constexpr uint64_t PAYLOAD_MASK = (1ull << TAG_SHIFT) - 1;
+        static constexpr uint64_t COUNT_SHIFT = 32;
+        static constexpr uint64_t COUNT_MASK = (1ull << (TAG_SHIFT - COUNT_SHIFT)) - 1;
+        static constexpr uint64_t JUMP_MASK = (1ull << COUNT_SHIFT) - 1;
+        static constexpr uint8_t CLOSE_TAG = 0xFF;
+
+        /**
+         * @brief Words and strings of the tape, kept on the heap so that elements stay valid when the tape is moved
+        */
+        struct Storage
         {
-            while (true)
-            {
-                auto& keyToken = tokens[curIndex++];
-                if (keyToken.Token == TokenType::EndOfFile)
-                {
-                    throw invalid_eof(keyToken);
-                }
-                if (keyToken.Token != TokenType::String)
-                {
-                    throw keys_not_string(keyToken);
-                }
-                const std::string key = keyToken.Value;
+            std::vector<uint64_t>	Tape;
+            std::string				Strings;
 
-                curIndex = expect(tokens[curIndex], TokenType::Colon, curIndex);
-                int nxtIndex;
-                auto value = parse(tokens, curIndex, nxtIndex);
-                curIndex = nxtIndex;
+            uint8_t tag_at(size_t index) const { return uint8_t(Tape[index] >> TAG_SHIFT); }
+            uint64_t payload_at(size_t index) const { return Tape[index] & PAYLOAD_MASK; }
+            size_t next_of(size_t index) const;
+            std::string_view string_at(size_t index) const;
+        };
 
-                list.push_back(m_pair{ key, value });
+        std::unique_ptr<Storage>	m_storage;
 
-                if (tokens[curIndex].Token == TokenType::Comma)
-                {
-                    curIndex++;
-                }
-                else
-                {
-                    break;
-                }
-            }
-            newIndex = expect(tokens[curIndex], TokenType::RightBrace, curIndex);
-            return list;
+        JsonTape() : m_storage(std::make_unique<Storage>()) {}
+
+        static uint64_t make_word(uint8_t tag, uint64_t payload) { return (uint64_t(tag) << TAG_SHIFT) | (payload & PAYLOAD_MASK); }
+        void append_string(std::string_view str);
+        void append_string(const JsonToken& token);
+        void build(const std::vector<JsonToken>& tokens, int index, int& newIndex);
+    };
+
+    /**
+     * @brief Lightweight handle to a value inside a JsonTape, valid as long as the tape is alive.
+     * Moving the tape keeps its elements valid, destroying it does not
+    */
+    class JsonElement
+    {
+    public:
+        class iterator;
+        class member_iterator;
+
+        JsonElement() : m_tape(nullptr), m_index(0) {}
+
+        ValueType GetType() const { return static_cast<ValueType>(m_tape->tag_at(m_index)); }
+
+        template<typename T>
+        T Get() const;
+
+        std::string_view GetStringView() const;
+
+        /**
+         * @brief Number of elements of an array or members of an object
+         * @return
+        */
+        size_t Size() const;
+
+        /**
+         * @brief Find a member of an object by linear scan
+         * @param name
+         * @return The member, or nullopt if it does not exist
+        */
+        std::optional<JsonElement> Find(std::string_view name) const;
+
+        JsonElement operator[](std::string_view name) const;
+
+        /**
+         * @brief Get an element of an array, skipping preceding siblings in O(index)
+         * @param index
+         * @return
+        */
+        JsonElement operator[](size_t index) const;
+
+        iterator begin() const;
+        iterator end() const;
+        iterator_range<member_iterator> items() const;
+    private:
+        friend class JsonTape;
+
+        JsonElement(const JsonTape::Storage* tape, size_t index) : m_tape(tape), m_index(index) {}
+
+        const JsonTape::Storage*	m_tape;
+        size_t			m_index;
+    };
+
+    class JsonElement::iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = JsonElement;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = JsonElement;
+
+        iterator() : m_tape(nullptr), m_index(0) {}
+        iterator(const JsonTape::Storage* tape, size_t index) : m_tape(tape), m_index(index) {}
+
+        JsonElement operator*() const { return JsonElement(m_tape, m_index); }
+        iterator& operator++() { m_index = m_tape->next_of(m_index); return *this; }
+        iterator operator++(int) { auto it = *this; ++(*this); return it; }
+        bool operator==(const iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const iterator& other) const { return m_index != other.m_index; }
+    private:
+        friend class JsonElement;
+
+        const JsonTape::Storage*	m_tape;
+        size_t			m_index;
+    };
+
+    class JsonElement::member_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<std::string_view, JsonElement>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        member_iterator() : m_tape(nullptr), m_index(0) {}
+        member_iterator(const JsonTape::Storage* tape, size_t index) : m_tape(tape), m_index(index) {}
+
+        value_type operator*() const { return { m_tape->string_at(m_index), JsonElement(m_tape, m_index + 1) }; }
+        member_iterator& operator++() { m_index = m_tape->next_of(m_index + 1); return *this; }
+        member_iterator operator++(int) { auto it = *this; ++(*this); return it; }
+        bool operator==(const member_iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const member_iterator& other) const { return m_index != other.m_index; }
+    private:
+        const JsonTape::Storage*	m_tape;
+        size_t			m_index;
+    };
+
+    inline JsonTape JsonTape::Parse(std::string_view text)
+    {
+        auto tokens = lex(text);
+        JsonTape tape;
+        // Each token produces at most two words
+        tape.m_storage->Tape.reserve(tokens.size() * 2);
+        int index = 0;
+        tape.build(tokens, 0, index);
+        if (tokens[index].Token != TokenType::EndOfFile)
+        {
+            throw root_not_singular_error(tokens[index]);
         }
-        else
+        return tape;
+    }
+
+    inline JsonElement JsonTape::Root() const
+    {
+        return JsonElement(m_storage.get(), 0);
+    }
+
+    inline size_t JsonTape::Storage::next_of(size_t index) const
+    {
+        switch (static_cast<ValueType>(tag_at(index)))
         {
-            newIndex = index + 1;
-            return list;
+        case SJson::ValueType::Object:
+        case SJson::ValueType::Array:
+            return payload_at(index) & JUMP_MASK;
+        case SJson::ValueType::Integer:
+        case SJson::ValueType::Float:
+            return index + 2;
+        default:
+            return index + 1;
         }
     }
 
-    inline arrlist parse_array(const std::vector<JsonToken>& tokens,
-        int index, int& newIndex)
+    inline void JsonTape::append_string(std::string_view str)
     {
-        arrlist list;
-        int curIndex = index;
-        if (tokens[curIndex].Token != TokenType::RightBracket)
+        auto& strings = m_storage->Strings;
+        m_storage->Tape.push_back(make_word(static_cast<uint8_t>(ValueType::String), strings.size()));
+        uint32_t length = static_cast<uint32_t>(str.size());
+        strings.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        strings.append(str);
+    }
+
+    inline void JsonTape::append_string(const JsonToken& token)
+    {
+        if (token.Value.find('\\') == std::string_view::npos)
         {
-            while (true)
-            {
-                int nxtIndex;
-                list.push_back(parse(tokens, curIndex, nxtIndex));
-                curIndex = nxtIndex;
-                if (tokens[curIndex].Token == TokenType::Comma)
-                {
-                    curIndex++;
-                }
-                else
-                {
-                    break;
-                }
-            }
-            newIndex = expect(tokens[curIndex], TokenType::RightBracket, curIndex);
-            return list;
+            append_string(token.Value);
         }
         else
         {
-            newIndex = index + 1;
-            return list;
+            append_string(remove_escapes(token.Value, token));
         }
     }
 
-    inline std::string remove_escapes(const std::string& str, const JsonToken& token)
+    inline std::string_view JsonTape::Storage::string_at(size_t index) const
     {
-        std::string result;
-        int len = str.size();
-        for (int i = 0; i < len; i++)
-        {
-            if (str[i] != '\\')
-            {
-                result.push_back(str[i]);
-                continue;
-            }
-            if (str[i] == '\\')
-            {
-                if (i == len - 1)
-                {
-                    throw invalid_escape_char(token);
-                }
-                switch (str[i + 1])
-                {
-                case 'n':
-                    result.push_back('\n');
-                    i++;
-                    break;
-                case 'r':
-                    result.push_back('\r');
-                    i++;
-                    break;
-                case 't':
-                    result.push_back('\t');
-                    i++;
-                    break;
-                case '\\':
-                    result.push_back('\\');
-                    i++;
-                    break;
-                default:
-                    throw invalid_escape_char(token);
-                    break;
-                }
-            }
-        }
-        return result;
+        size_t offset = payload_at(index);
+        uint32_t length;
+        std::memcpy(&length, Strings.data() + offset, sizeof(length));
+        return std::string_view(Strings.data() + offset + sizeof(length), length);
     }
 
-    inline JsonNode parse(const std::vector<JsonToken>& tokens, int index, int& newIndex)
+    inline void JsonTape::build(const std::vector<JsonToken>& tokens, int index, int& newIndex)
     {
+        auto& tape = m_storage->Tape;
         auto& token = tokens[index];
         switch (token.Token)
         {
         case TokenType::Null:
         {
             newIndex = index + 1;
-            return JsonNode();
+            tape.push_back(make_word(static_cast<uint8_t>(ValueType::Null), 0));
+            return;
+        }
+        case TokenType::True:
+        case TokenType::False:
+        {
+            newIndex = index + 1;
+            tape.push_back(make_word(static_cast<uint8_t>(ValueType::Boolean), token.Token == TokenType::True));
+            return;
         }
         case TokenType::Integer:
         {
             newIndex = index + 1;
-            return JsonNode(std::stoll(token.Value, nullptr, 10));
+            int64_t value = std::stoll(std::string(token.Value), nullptr, 10);
+            tape.push_back(make_word(static_cast<uint8_t>(ValueType::Integer), 0));
+            tape.push_back(static_cast<uint64_t>(value));
+            return;
         }
         case TokenType::Float:
         {
-            newIndex = index + 1;
-            return JsonNode(std::stod(token.Value, nullptr));
+            newIndex = index + 1;
+            double value = std::stod(std::string(token.Value), nullptr);
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            tape.push_back(make_word(static_cast<uint8_t>(ValueType::Float), 0));
+            tape.push_back(bits);
+            return;
+        }
+        case TokenType::String:
+        {
+            newIndex = index + 1;
+            append_string(token);
+            return;
+        }
+        case TokenType::LeftBrace:
+        case TokenType::LeftBracket:
+        {
+            bool isObject = token.Token == TokenType::LeftBrace;
+            TokenType closeToken = isObject ? TokenType::RightBrace : TokenType::RightBracket;
+            size_t open = tape.size();
+            tape.push_back(0);
+            uint64_t count = 0;
+            int curIndex = index + 1;
+            if (tokens[curIndex].Token != closeToken)
+            {
+                while (true)
+                {
+                    if (isObject)
+                    {
+                        auto& keyToken = tokens[curIndex++];
+                        if (keyToken.Token == TokenType::EndOfFile)
+                        {
+                            throw invalid_eof(keyToken);
+                        }
+                        if (keyToken.Token != TokenType::String)
+                        {
+                            throw keys_not_string(keyToken);
+                        }
+                        append_string(keyToken);
+                        curIndex = expect(tokens[curIndex], TokenType::Colon, curIndex);
+                    }
+                    int nxtIndex;
+                    build(tokens, curIndex, nxtIndex);
+                    curIndex = nxtIndex;
+                    count++;
+                    if (tokens[curIndex].Token == TokenType::Comma)
+                    {
+                        curIndex++;
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+                newIndex = expect(tokens[curIndex], closeToken, curIndex);
+            }
+            else
+            {
+                newIndex = curIndex + 1;
+            }
+            size_t close = tape.size();
+            if (close + 1 > JUMP_MASK)
+            {
+                // The jump would overflow into the count bits and break navigation
+                throw std::length_error("JSON document is too large for a tape");
+            }
+            tape.push_back(make_word(CLOSE_TAG, open));
+            auto type = isObject ? ValueType::Object : ValueType::Array;
+            tape[open] = make_word(static_cast<uint8_t>(type),
+                (std::min(count, COUNT_MASK) << COUNT_SHIFT) | (close + 1));
+            return;
+        }
+        case TokenType::EndOfFile:
+        {
+            throw invalid_eof(token);
+        }
+        default:
+            break;
+        }
+        throw parse_match_failed(token);
+    }
+
+    template<typename T>
+    inline T JsonElement::Get() const
+    {
+        if constexpr (std::is_same<std::decay_t<T>, bool>::value)
+        {
+            assert(GetType() == ValueType::Boolean);
+            return m_tape->payload_at(m_index) != 0;
+        }
+        else if constexpr (std::is_integral<std::decay_t<T>>::value)
+        {
+            assert(GetType() == ValueType::Integer);
+            return static_cast<T>(static_cast<int64_t>(m_tape->Tape[m_index + 1]));
+        }
+        else if constexpr (std::is_floating_point<std::decay_t<T>>::value)
+        {
+            assert(GetType() == ValueType::Float);
+            double value;
+            std::memcpy(&value, &m_tape->Tape[m_index + 1], sizeof(value));
+            return static_cast<T>(value);
         }
-        case TokenType::True:
+        else if constexpr (std::is_same<std::decay_t<T>, std::string>::value)
         {
-            newIndex = index + 1;
-            return JsonNode(true);
+            return std::string(GetStringView());
         }
-        case TokenType::False:
+        else
         {
-            newIndex = index + 1;
-            return JsonNode(false);
+            static_assert(false, "Cannot get an un-supportted type");
         }
-        case TokenType::String:
+    }
+
+    inline std::string_view JsonElement::GetStringView() const
+    {
+        assert(GetType() == ValueType::String);
+        return m_tape->string_at(m_index);
+    }
+
+    inline size_t JsonElement::Size() const
+    {
+        assert(GetType() == ValueType::Array || GetType() == ValueType::Object);
+        uint64_t count = (m_tape->payload_at(m_index) >> JsonTape::COUNT_SHIFT) & JsonTape::COUNT_MASK;
+        if (count < JsonTape::COUNT_MASK)
         {
-            newIndex = index + 1;
-            return JsonNode(remove_escapes(token.Value, token));
+            return count;
         }
-        case TokenType::LeftBrace:
+        // The stored count saturated, so walk the children
+        size_t size = 0;
+        for (auto it = begin(); it != end(); ++it)
         {
-            JsonNode node = JsonNode(object_type_init());
-            auto&& obj = parse_object(tokens, index + 1, newIndex);
-            for (auto& pair : obj)
-            {
-                node[pair.first] = pair.second;
-            }
-            return node;
+            size++;
         }
-        case TokenType::LeftBracket:
+        return GetType() == ValueType::Object ? size / 2 : size;
+    }
+
+    inline std::optional<JsonElement> JsonElement::Find(std::string_view name) const
+    {
+        assert(GetType() == ValueType::Object);
+        for (auto [key, value] : items())
         {
-            JsonNode node = JsonNode(array_type_init());
-            auto&& arr = parse_array(tokens, index + 1, newIndex);
-            for (auto& element : arr)
+            if (key == name)
             {
-                node.push_back(element);
+                return value;
             }
-            return node;
         }
-        case TokenType::EndOfFile:
+        return std::nullopt;
+    }
+
+    inline JsonElement JsonElement::operator[](std::string_view name) const
+    {
+        auto member = Find(name);
+        if (!member)
         {
-            throw invalid_eof(token);
-        }
-        default:
-            break;
+            throw std::logic_error("Given key does not exist");
         }
-        throw parse_match_failed(token);
+        return *member;
     }
 
-    inline JsonNode JsonConvert::Parse(const std::string& text)
+    inline JsonElement JsonElement::operator[](size_t index) const
     {
-        auto tokens = lex(text);
-        int index = 0;
-        auto node = parse(tokens, 0, index);
-        if (tokens[index].Token != TokenType::EndOfFile)
+        assert(GetType() == ValueType::Array);
+        auto it = begin();
+        for (size_t i = 0; i < index; i++)
         {
-            throw root_not_singular_error(tokens[index]);
+            ++it;
         }
-        return node;
+        return *it;
+    }
+
+    inline JsonElement::iterator JsonElement::begin() const
+    {
+        assert(GetType() == ValueType::Array || GetType() == ValueType::Object);
+        return iterator(m_tape, m_index + 1);
+    }
+
+    inline JsonElement::iterator JsonElement::end() const
+    {
+        assert(GetType() == ValueType::Array || GetType() == ValueType::Object);
+        return iterator(m_tape, m_tape->next_of(m_index) - 1);
+    }
+
+    inline iterator_range<JsonElement::member_iterator> JsonElement::items() const
+    {
+        assert(GetType() == ValueType::Object);
+        return { member_iterator(m_tape, m_index + 1), member_iterator(m_tape, m_tape->next_of(m_index) - 1) };
     }
 
     inline std::string GetValueTypeName(ValueType type)
@@ -1159,6 +5385,21 @@ namespace SJson
         return JsonNode(list);
     }
 
+    inline JsonNode borrow(std::string_view value)
+    {
+        return JsonNode(value);
+    }
+
+    inline JsonNode number(std::string_view lexeme)
+    {
+        bool integer;
+        if (lexeme.empty() || try_lex_number(lexeme, 0, integer) != (int)lexeme.size() - 1 || !is_strict_number(lexeme))
+        {
+            throw std::invalid_argument("Not a number: " + std::string(lexeme));
+        }
+        return JsonNode(JsonNumber(lexeme, false), integer ? ValueType::Integer : ValueType::Float);
+    }
+
     //
     // Serialization
     // 序列化
@@ -1395,64 +5636,368 @@ namespace SJson
         return json;
     }
 
+    //
+    // Direct serialization
+    // 直接序列化
+    //
+
+    /**
+     * @brief Members of a reflected type in the order a JsonNode object would list them:
+     * fields by name and base classes as "$Name", all sorted like std::string keys
+     * @tparam T
+    */
+    template<typename T>
+    struct reflected_members
+    {
+        static constexpr size_t count_fields()
+        {
+            if constexpr (SRefl::has_fields_v<T>)
+            {
+                return std::tuple_size<decltype(SRefl::TypeInfo<T>::_FIELDLIST())>::value;
+            }
+            return 0;
+        }
+
+        static constexpr size_t count_bases()
+        {
+            if constexpr (SRefl::has_bases_v<T>)
+            {
+                return std::tuple_size<decltype(SRefl::TypeInfo<T>::_BASELIST())>::value;
+            }
+            return 0;
+        }
+
+        static constexpr size_t FieldCount = count_fields();
+        static constexpr size_t BaseCount = count_bases();
+        static constexpr size_t Count = FieldCount + BaseCount;
+
+        // Member i is field i, or base i - FieldCount
+        static constexpr std::array<std::string_view, Count> names()
+        {
+            std::array<std::string_view, Count> result{};
+            if constexpr (FieldCount > 0)
+            {
+                SRefl::for_sequence(std::make_index_sequence<FieldCount>{}, [&](auto i) {
+                    result[i] = std::get<i>(SRefl::TypeInfo<T>::_FIELDLIST()).Name;
+                    });
+            }
+            if constexpr (BaseCount > 0)
+            {
+                SRefl::for_sequence(std::make_index_sequence<BaseCount>{}, [&](auto i) {
+                    result[FieldCount + i] = std::get<i>(SRefl::TypeInfo<T>::_BASELIST()).Name;
+                    });
+            }
+            return result;
+        }
+
+        // Compares the keys of two members, the key of a base having a '$' prefix
+        static constexpr bool key_less(size_t lhs, size_t rhs)
+        {
+            constexpr auto memberNames = names();
+            auto keyChar = [&memberNames](size_t member, size_t at) {
+                return member < FieldCount ? memberNames[member][at]
+                    : at == 0 ? '$' : memberNames[member][at - 1];
+            };
+            size_t lhsSize = memberNames[lhs].size() + (lhs < FieldCount ? 0 : 1);
+            size_t rhsSize = memberNames[rhs].size() + (rhs < FieldCount ? 0 : 1);
+            for (size_t i = 0; i < lhsSize && i < rhsSize; i++)
+            {
+                auto a = static_cast<unsigned char>(keyChar(lhs, i));
+                auto b = static_cast<unsigned char>(keyChar(rhs, i));
+                if (a != b)
+                {
+                    return a < b;
+                }
+            }
+            return lhsSize < rhsSize;
+        }
+
+        static constexpr std::array<size_t, Count> sorted()
+        {
+            std::array<size_t, Count> order{};
+            for (size_t i = 0; i < Count; i++)
+            {
+                order[i] = i;
+            }
+            // Insertion sort, the member count is small
+            for (size_t i = 1; i < Count; i++)
+            {
+                for (size_t j = i; j > 0 && key_less(order[j], order[j - 1]); j--)
+                {
+                    auto swap = order[j];
+                    order[j] = order[j - 1];
+                    order[j - 1] = swap;
+                }
+            }
+            return order;
+        }
+
+        static constexpr std::array<size_t, Count> Order = sorted();
+    };
+
+    /**
+     * @brief Key text of one member of a reflected type, built at compile time
+     * @tparam T
+     * @tparam Member Index into reflected_members<T>::names()
+    */
+    template<typename T, size_t Member>
+    struct reflected_key
+    {
+        static constexpr std::string_view Name = reflected_members<T>::names()[Member];
+        static constexpr bool IsBase = Member >= reflected_members<T>::FieldCount;
+        static constexpr size_t KeySize = Name.size() + (IsBase ? 1 : 0);
+
+        // Writes the key into out, wrapped in quote if it is not 0, then ": "
+        template<size_t Size>
+        static constexpr std::array<char, Size> make(char quote)
+        {
+            std::array<char, Size> out{};
+            size_t at = 0;
+            if (quote != 0)
+            {
+                out[at++] = quote;
+            }
+            if (IsBase)
+            {
+                out[at++] = '$';
+            }
+            for (char c : Name)
+            {
+                out[at++] = c;
+            }
+            if (quote != 0)
+            {
+                out[at++] = quote;
+            }
+            out[at++] = ':';
+            out[at++] = ' ';
+            return out;
+        }
+
+        static constexpr bool plain()
+        {
+            for (char c : Name)
+            {
+                if (static_cast<unsigned char>(c) < 0x20 || c == '\"' || c == '\\')
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        static_assert(plain(), "Reflected names are written without escaping");
+
+        static constexpr std::array<char, KeySize + 4> Quoted = make<KeySize + 4>('\"');
+        static constexpr std::array<char, KeySize + 2> Unquoted = make<KeySize + 2>(0);
+        static constexpr JsonKeyLiteral Literal = {
+            std::string_view(Quoted.data(), Quoted.size()),
+            std::string_view(Unquoted.data(), Unquoted.size())
+        };
+    };
+
+    /**
+     * @brief Write a value straight to a JsonWriter, producing the same text as
+     * serialize(v).ToString() without building the tree
+     * @param writer
+     * @param v
+    */
+    inline void serialize(JsonWriter& writer, std::string_view v)
+    {
+        writer.Value(v);
+    }
+
+    // Exact match only, JsonNode converts from too many types
+    template<typename T, t_enable_if_same_type<T, JsonNode> = nullptr>
+    inline void serialize(JsonWriter& writer, const T& v)
+    {
+        v.Write(writer);
+    }
+
+    template<typename T, std::enable_if_t<std::is_fundamental<T>::value, nullptr_t> = nullptr>
+    inline void serialize(JsonWriter& writer, const T& v)
+    {
+        writer.Value(v);
+    }
+
+    template<typename T, std::enable_if_t<is_vector<T>::value, nullptr_t> = nullptr>
+    inline void serialize(JsonWriter& writer, const T& v)
+    {
+        using value_type = typename T::value_type;
+        writer.StartArray(v.size(), std::is_arithmetic<value_type>::value || std::is_enum<value_type>::value || std::is_convertible<const value_type&, std::string_view>::value);
+        writer.WriteRange(v.begin(), v.end(), [](JsonWriter& writer, const auto& e) { serialize(writer, e); });
+        writer.EndArray();
+    }
+
+    template<typename T, std::enable_if_t<std::is_enum<T>::value, nullptr_t> = nullptr>
+    inline void serialize(JsonWriter& writer, const T& v)
+    {
+        writer.Value(SRefl::EnumInfo<T>::enum_to_string(v));
+    }
+
+    template<typename K, typename V>
+    inline void serialize(JsonWriter& writer, const std::pair<K, V>& v)
+    {
+        constexpr JsonKeyLiteral keyKey = { "\"key\": ", "key: " };
+        constexpr JsonKeyLiteral valueKey = { "\"value\": ", "value: " };
+        writer.StartObject();
+        writer.Key(keyKey);
+        serialize(writer, v.first);
+        writer.Key(valueKey);
+        serialize(writer, v.second);
+        writer.EndObject();
+    }
+
+    template<bool _To_Obj = false, typename K, typename V, typename Cmp, typename Alloc>
+    inline void serialize(JsonWriter& writer, const std::map<K, V, Cmp, Alloc>& v)
+    {
+        if constexpr (_To_Obj && std::is_same<std::decay_t<K>, std::string>::value)
+        {
+            // Members have to come out in key order, whatever order the map keeps
+            serialize<true>(v).Write(writer);
+        }
+        else
+        {
+            writer.StartArray();
+            for (auto& pair : v)
+            {
+                serialize(writer, pair);
+            }
+            writer.EndArray();
+        }
+    }
+
+    template<typename... Ts>
+    inline void serialize(JsonWriter& writer, const std::tuple<Ts...>& v)
+    {
+        writer.StartArray();
+        SRefl::for_sequence(std::make_index_sequence<sizeof...(Ts)>{}, [&](auto i) {
+            serialize(writer, std::get<i>(v));
+            });
+        writer.EndArray();
+    }
+
+    template<typename T, std::enable_if_t<SRefl::has_fields_v<T>, nullptr_t> = nullptr>
+    inline void serialize(JsonWriter& writer, const T& v)
+    {
+        using members = reflected_members<T>;
+        writer.StartObject();
+        SRefl::for_sequence(std::make_index_sequence<members::Count>{}, [&](auto i) {
+            constexpr size_t member = members::Order[i];
+            writer.Key(reflected_key<T, member>::Literal);
+            if constexpr (member < members::FieldCount)
+            {
+                constexpr auto field = std::get<member>(SRefl::TypeInfo<T>::_FIELDLIST());
+                serialize(writer, v.*(field.MemberPtr));
+            }
+            else
+            {
+                constexpr auto baseRef = std::get<member - members::FieldCount>(SRefl::TypeInfo<T>::_BASELIST());
+                using baseType = typename decltype(baseRef)::_Type;
+                serialize(writer, static_cast<const baseType&>(v));
+            }
+            });
+        writer.EndObject();
+    }
+
     //
     // De-serialization
     // 反序列化
     // 
 
     /**
-     * @brief If is primitive types, we can directly get value from JSON
+     * @brief Call func(field, key) for every reflected field of T, where key is the
+     * field name as a JsonKey hashed at compile time
      * @tparam T
-     * @param v
+     * @param func
+    */
+    template<typename T, typename F>
+    constexpr void for_each_field_key(F&& func)
+    {
+        constexpr auto nFields = std::tuple_size<decltype(SRefl::TypeInfo<T>::_FIELDLIST())>::value;
+        SRefl::for_sequence(std::make_index_sequence<nFields>{}, [&](auto i) {
+            constexpr auto field = std::get<i>(SRefl::TypeInfo<T>::_FIELDLIST());
+            constexpr JsonKey key(field.Name);
+            func(field, key);
+            });
+    }
+
+    template<typename Node, typename Key>
+    inline Node& find_member(Node& node, const Key& name)
+    {
+        auto member = node.Find(name);
+        if (member == nullptr)
+        {
+            throw std::logic_error("Given key does not exist");
+        }
+        return *member;
+    }
+
+    /**
+     * @brief Shared body of both de_serialize overloads. Node is const JsonNode to copy
+     * values out of the tree, or JsonNode to move strings and containers out of a temporary one
+     * @tparam T
+     * @param node
      * @return
     */
-    template<typename T>
-    constexpr T de_serialize(const JsonNode& node)
+    template<typename T, typename Node>
+    constexpr T de_serialize_node(Node& node)
     {
+        // Children of a movable node are movable too, so recursing on lvalues keeps the mode
+        constexpr bool moving = !std::is_const<Node>::value;
         if constexpr (std::is_fundamental<T>::value)
         {
-            return node.Get<T>();
+            return node.template Get<T>();
+        }
+        else if constexpr (std::is_same<T, std::string>::value)
+        {
+            if constexpr (moving)
+            {
+                return std::move(node).template Take<std::string>();
+            }
+            else
+            {
+                return node.template Get<std::string>();
+            }
         }
         else if constexpr (is_vector<T>::value)
         {
             T vec;
-            node.foreach([&](const JsonNode& e) {
-                vec.push_back(de_serialize<typename T::value_type>(e));
-            });
+            if constexpr (std::is_arithmetic<typename T::value_type>::value && !std::is_same<typename T::value_type, bool>::value)
+            {
+                if (node.IsPacked())
+                {
+                    node.CopyNumbers(vec);
+                    return vec;
+                }
+            }
+            vec.reserve(node.Size());
+            for (auto& e : node)
+            {
+                vec.push_back(de_serialize_node<typename T::value_type>(e));
+            }
             return vec;
         }
         else if constexpr (is_map<T>::value)
         {
             T mapp;
-            node.foreach([&](const JsonNode& e) {
-                auto key = de_serialize<typename T::key_type>(e["key"]);
-                auto value = de_serialize<typename T::mapped_type>(e["value"]);
-                mapp[key] = value;
-            });
+            for (auto& e : node)
+            {
+                auto key = de_serialize_node<typename T::key_type>(find_member(e, "key"));
+                auto value = de_serialize_node<typename T::mapped_type>(find_member(e, "value"));
+                mapp[std::move(key)] = std::move(value);
+            }
             return mapp;
         }
         else if constexpr (std::is_enum<T>::value)
         {
-            return SRefl::EnumInfo<T>::string_to_enum(node.Get<std::string>());
+            return SRefl::EnumInfo<T>::string_to_enum(de_serialize_node<std::string>(node));
         }
         else if constexpr (SRefl::has_fields_v<T>)
         {
             T result;
-            SRefl::ForEachField<T>([&result, &node](auto field) {
-                result.*(field.MemberPtr) = de_serialize<decltype(field)::_Type>(node[field.Name]);
+            for_each_field_key<T>([&result, &node](auto field, const JsonKey& key) {
+                result.*(field.MemberPtr) = de_serialize_node<decltype(field)::_Type>(find_member(node, key));
                 });
-            //// We first get the number of properties
-            //constexpr auto nbProperties = std::tuple_size<decltype(T::properties())>::value;
-
-            //// We iterate on the index sequence of size `nbProperties`
-            //for_sequence(std::make_index_sequence<nbProperties>{}, [&](auto i) {
-            //    // get the property
-            //    constexpr auto prop = std::get<i>(T::properties());
-
-            //    // set the value to the member
-            //    result.*(prop.member) = de_serialize<decltype(prop)::Type>(node[prop.name]);
-            //    });
-
             if constexpr (SRefl::has_bases_v<T>)
             {
                 SRefl::ForEachBase<T>([&result, &node](auto baseRef) {
@@ -1460,18 +6005,8 @@ namespace SJson
                     baseType& base = result;
                     std::string key = "$";
                     key.append(baseRef.Name);
-                    base = de_serialize<baseType>(node[key]);
+                    base = de_serialize_node<baseType>(find_member(node, key));
                     });
-                //constexpr auto nParents = std::tuple_size<decltype(T::parents())>::value;
-                //for_sequence(std::make_index_sequence<nParents>{}, [&](auto i) {
-                //    constexpr auto classRef = std::get<i>(T::parents());
-
-                //    using baseType = typename decltype(classRef)::Type;
-                //    baseType& base = result;
-                //    std::string key = "$";
-                //    key.append(classRef.name);
-                //    base = de_serialize<baseType>(node[key]);
-                //    });
             }
             return result;
         }
@@ -1481,21 +6016,68 @@ namespace SJson
         }
     }
 
-    template<>
-    inline std::string de_serialize(const JsonNode& node)
+    /**
+     * @brief If is primitive types, we can directly get value from JSON
+     * @tparam T
+     * @param v
+     * @return
+    */
+    template<typename T>
+    constexpr T de_serialize(const JsonNode& node)
+    {
+        return de_serialize_node<T>(node);
+    }
+
+    /**
+     * @brief Same as de_serialize above, but moves strings and containers out of
+     * a temporary tree instead of copying them
+     * @tparam T
+     * @param node
+     * @return
+    */
+    template<typename T>
+    constexpr T de_serialize(JsonNode&& node)
     {
-        return node.Get<std::string>();
+        return de_serialize_node<T>(node);
     }
 
     template<typename T>
     inline std::string JsonConvert::Serialize(const T& v, const JsonFormatOption& option)
     {
-        return serialize(v).ToString(option);
+        JsonWriter writer(option);
+        if (option.PreMeasure)
+        {
+            writer.Reserve(SerializedSize(v, option));
+        }
+        serialize(writer, v);
+        return writer.Take();
+    }
+
+    template<typename T>
+    inline size_t JsonConvert::SerializedSize(const T& v, const JsonFormatOption& option)
+    {
+        auto writer = JsonWriter::Measure(option);
+        serialize(writer, v);
+        return writer.Size();
+    }
+
+    template<typename T>
+    inline void JsonConvert::SerializeTo(const T& v, JsonSink& sink, const JsonFormatOption& option)
+    {
+        JsonWriter writer(sink, option);
+        serialize(writer, v);
+        writer.Flush();
     }
 
     template<typename T>
     inline T JsonConvert::Deserialize(const std::string jsonStr)
     {
+        // The parsed tree is a temporary, so strings and containers are moved out of it
         return de_serialize<T>(Parse(jsonStr));
     }
 }
+
+inline size_t std::hash<SJson::JsonNode>::operator()(const SJson::JsonNode& node) const
+{
+    return static_cast<size_t>(node.Hash());
+}
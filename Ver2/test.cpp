@@ -54,6 +54,28 @@ void expect_parse_throw_error(const std::string& text, const char* file, int lin
 }
 
 
+template<typename T>
+void expect_tape_throw_error(const std::string& text, const char* file, int line, const char* name)
+{
+    test_count++;
+    try
+    {
+        SJson::JsonTape::Parse(text);
+    }
+    catch (T& e)
+    {
+        test_pass++;
+        return;
+    }
+    catch (std::exception& e)
+    {
+        fprintf(stderr, "%s:%d: expect throw: %s, actual: %s\n", file, line, name, typeid(e).name());
+        return;
+    }
+    fprintf(stderr, "%s:%d: expect to throw %s, but none was thrown\n", file, line, name);
+}
+
+
 template<typename T, typename E>
 void expect_deserialize_throw_error(const std::string& text, const char* file, int line, const char* name)
 {
@@ -325,6 +347,7 @@ void expect_equal(const SJson::JsonNode& node, std::string expected, const char*
 }
 
 #define EXPECT_PARSE_THROW(text, error) expect_parse_throw_error<error>(text, __FILE__, __LINE__, #error)
+#define EXPECT_PARSE_THROW_TAPE(text, error) expect_tape_throw_error<error>(text, __FILE__, __LINE__, #error)
 #define EXPECT_PARSE_NOTHROW(text) expect_parse_nothrow(text, __FILE__, __LINE__)
 #define EXPECT_PARSE_TYPE(text, type) expect_parse_type(text, __FILE__, __LINE__, type)
 #define EXPECT_PARSE_BOOL_VALUE(text, value) expect_parse_value<bool>(text, __FILE__, __LINE__, value)
@@ -491,12 +514,18 @@ static void test_parse_string()
     EXPECT_PARSE_STRING_VALUE(R"("He ll o")", "He ll o");
     EXPECT_PARSE_STRING_VALUE(R"("Hello\n")", "Hello\n");
     EXPECT_PARSE_STRING_VALUE(R"("\n")", "\n");
+    EXPECT_PARSE_STRING_VALUE(R"("say \"hi\"")", "say \"hi\"");
+    EXPECT_PARSE_STRING_VALUE(R"("\/\b\f")", "/\b\f");
+    EXPECT_PARSE_STRING_VALUE(R"("\u0041\u00e9\u4e2d")", "A\xc3\xa9\xe4\xb8\xad");
+    EXPECT_PARSE_STRING_VALUE(R"("\ud83d\ude00")", "\xf0\x9f\x98\x80");
 
     EXPECT_PARSE_THROW(R"(")", SJson::lexical_error);
     EXPECT_PARSE_THROW(R"("123142)", SJson::lexical_error);
     EXPECT_PARSE_THROW(R"('23142')", SJson::lexical_error);
     EXPECT_PARSE_THROW(R"("\q")", SJson::invalid_escape_char);
     EXPECT_PARSE_THROW(R"("\ ")", SJson::invalid_escape_char);
+    EXPECT_PARSE_THROW(R"("\u12")", SJson::invalid_escape_char);
+    EXPECT_PARSE_THROW(R"("\ud83d")", SJson::invalid_escape_char);
 }
 
 
@@ -669,7 +698,7 @@ static void test_to_string()
     EXPECT_EQ_STRING(node.ToString(SJson::DefaultOption), "null");
 
     node = 3.14159265357;
-    EXPECT_EQ_STRING(node.ToString(SJson::DefaultOption), "3.1415926535700001");
+    EXPECT_EQ_STRING(node.ToString(SJson::DefaultOption), "3.14159265357");
 
     node = "hello world";
     EXPECT_EQ_STRING(node.ToString(SJson::DefaultOption), R"("hello world")");
@@ -681,6 +710,866 @@ static void test_to_string()
     EXPECT_EQ_STRING(node.ToString(SJson::DefaultOption), R"({first: 1, second: 2})");
 }
 
+static void test_borrowed_strings()
+{
+    std::string text = R"({"Name": "Test", "Escaped": "a\tb", "List": ["x", "y"]})";
+    auto node = SJson::JsonConvert::Parse(text, SJson::BorrowedParseOption);
+    EXPECT_EQ_BOOL(node["Name"].IsBorrowed(), true);
+    EXPECT_EQ_BOOL(node["Escaped"].IsBorrowed(), false);
+    EXPECT_EQ_STRING(node["Name"], "Test");
+    EXPECT_EQ_STRING(node["Escaped"], "a\tb");
+    EXPECT_EQ_STRING(node["List"][1], "y");
+    EXPECT_EQ_STRING(node.ToString(SJson::DefaultOption), "{Escaped: \"a\\tb\", List: [\"x\", \"y\"], Name: \"Test\"}");
+
+    node["Name"].GetMutableString().append("ing");
+    EXPECT_EQ_BOOL(node["Name"].IsBorrowed(), false);
+    EXPECT_EQ_STRING(node["Name"], "Testing");
+
+    node.MakeOwned();
+    text.assign(text.size(), ' ');
+    EXPECT_EQ_STRING(node["List"][0], "x");
+
+    SJson::JsonDocument document(R"({"Camera": {"Type": "Normal"}})");
+    SJson::JsonDocument moved = std::move(document);
+    EXPECT_EQ_BOOL(moved.Root()["Camera"]["Type"].IsBorrowed(), true);
+    EXPECT_EQ_STRING(moved.Root()["Camera"]["Type"], "Normal");
+}
+
+static void test_move_out()
+{
+    auto node = SJson::JsonConvert::Parse(R"({"Name": "Test", "List": [1, 2, 3], "Obj": {"A": 1}})");
+    EXPECT_EQ_BOOL(node["Name"].GetStringView() == "Test", true);
+
+    auto list = node["List"].AsArray();
+    EXPECT_EQ_INT((int64_t)list.size(), 3LL);
+    EXPECT_EQ_INT(list[2], 3LL);
+    list[0] = 10;
+    EXPECT_EQ_INT(node["List"][0], 10LL);
+    EXPECT_EQ_INT((int64_t)node["Obj"].AsObject().size(), 1LL);
+
+    auto name = std::move(node["Name"]).Take<std::string>();
+    EXPECT_EQ_STRING(name, "Test");
+    auto array = std::move(node["List"]).Take<SJson::array_type>();
+    EXPECT_EQ_INT((int64_t)array.size(), 3LL);
+    auto value = std::move(node["Obj"]).Release();
+    EXPECT_NODE_TYPE(node["Obj"], SJson::ValueType::Null);
+    EXPECT_EQ_BOOL(std::holds_alternative<std::shared_ptr<SJson::object_type>>(value), true);
+}
+
+static void test_move_node()
+{
+    SJson::JsonNode source = "moved";
+    SJson::JsonNode target = std::move(source);
+    EXPECT_NODE_TYPE(source, SJson::ValueType::Null);
+    EXPECT_EQ_STRING(target.Get<std::string>(), "moved");
+
+    auto duplicated = SJson::JsonConvert::Parse(R"({"Key": 1, "Key": [2]})");
+    EXPECT_EQ_INT((int64_t)duplicated.Size(), 1LL);
+    EXPECT_EQ_INT(duplicated["Key"][0], 2LL);
+}
+
+static void test_snapshot()
+{
+    SJson::SharedDocument config(SJson::JsonDocument(R"({"Version": 0, "Name": "config0"})"));
+    EXPECT_EQ_INT(config.Read()->Root()["Version"], 0LL);
+
+    std::atomic<bool> stop = false;
+    std::atomic<int> inconsistent = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; i++)
+    {
+        readers.emplace_back([&]() {
+            int64_t last = 0;
+            while (!stop.load())
+            {
+                auto guard = config.Read();
+                auto& root = guard->Root();
+                auto version = root["Version"].Get<int64_t>();
+                // Versions never go back, and a version is never torn
+                if (version < last || root["Name"].GetStringView() != "config" + std::to_string(version))
+                {
+                    inconsistent++;
+                }
+                last = version;
+            }
+        });
+    }
+    for (int version = 1; version <= 100; version++)
+    {
+        config.Publish(SJson::JsonDocument("{\"Version\": " + std::to_string(version)
+            + ", \"Name\": \"config" + std::to_string(version) + "\"}"));
+    }
+    stop = true;
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+    EXPECT_EQ_INT((int64_t)inconsistent.load(), 0LL);
+    EXPECT_EQ_INT(config.Read()->Root()["Version"], 100LL);
+}
+
+static void test_deduplicate()
+{
+    const char* text = R"({"A": {"Color": [1, 1, 1], "Name": "stone"}, "B": {"Color": [1, 1, 1], "Name": "stone"},
+        "C": {"Color": [1, 1, 1], "Name": "wood"}, "D": [0.0, -0.0], "E": [0.0, 0.0]})";
+    auto node = SJson::JsonConvert::Parse(text);
+    auto expected = node.ToString(SJson::InlineWithQuoteOption);
+    node.Deduplicate();
+    EXPECT_EQ_STRING(node.ToString(SJson::InlineWithQuoteOption), expected);
+
+    const auto& root = node;
+    EXPECT_EQ_BOOL(&root["A"]["Name"] == &root["B"]["Name"], true);
+    EXPECT_EQ_BOOL(&root["A"]["Color"][0] == &root["C"]["Color"][0], true);
+    EXPECT_EQ_BOOL(&root["A"]["Name"] == &root["C"]["Name"], false);
+    EXPECT_EQ_BOOL(&root["D"][0] == &root["E"][0], false);
+
+    node["B"]["Name"] = "iron";
+    EXPECT_EQ_STRING(node["A"]["Name"].Get<std::string>(), "stone");
+    EXPECT_EQ_STRING(node["B"]["Name"].Get<std::string>(), "iron");
+
+    SJson::JsonParseOption option = SJson::PackedParseOption;
+    option.Deduplicate = true;
+    auto packed = SJson::JsonConvert::Parse(text, option);
+    EXPECT_EQ_BOOL(packed["A"].IsShared(), true);
+    EXPECT_EQ_BOOL(packed["A"]["Color"].GetNumbers<int64_t>().data() == packed["C"]["Color"].GetNumbers<int64_t>().data(), true);
+
+    // Payloads shared by an earlier pass, or by copies, are not cloned again
+    auto twice = SJson::JsonConvert::Parse(text);
+    twice.Deduplicate();
+    const auto& shared = twice;
+    auto name = &shared["A"]["Name"];
+    auto color = &shared["A"]["Color"][0];
+    const auto copy = twice;
+    twice.Deduplicate();
+    EXPECT_EQ_BOOL(&shared["A"]["Name"] == name, true);
+    EXPECT_EQ_BOOL(&shared["B"]["Name"] == name, true);
+    EXPECT_EQ_BOOL(&shared["C"]["Color"][0] == color, true);
+    EXPECT_EQ_BOOL(&copy["A"]["Name"] == name, true);
+}
+
+static void test_equality()
+{
+    const char* text = R"({"List": [1, 2, 3], "Mixed": [0.0, 2.5], "Name": "test"})";
+    auto node = SJson::JsonConvert::Parse(text);
+    auto lazy = SJson::JsonConvert::Parse(text, SJson::LazyParseOption);
+    auto packed = SJson::JsonConvert::Parse(text, SJson::PackedParseOption);
+    EXPECT_EQ_BOOL(node == lazy, true);
+    EXPECT_EQ_BOOL(node == packed, true);
+    EXPECT_EQ_BOOL(node.Hash() == lazy.Hash(), true);
+    EXPECT_EQ_BOOL(node.Hash() == packed.Hash(), true);
+    EXPECT_EQ_BOOL(SJson::JsonNode(-0.0) == SJson::JsonNode(0.0), true);
+    EXPECT_EQ_BOOL(SJson::JsonNode(-0.0).Hash() == SJson::JsonNode(0.0).Hash(), true);
+    EXPECT_EQ_BOOL(SJson::JsonNode(1) == SJson::JsonNode(1.0), false);
+    auto big = SJson::number("123456789012345678901234567890");
+    EXPECT_EQ_BOOL(big == SJson::number("123456789012345678901234567890"), true);
+    EXPECT_EQ_BOOL(big == SJson::number("123456789012345678901234567891"), false);
+
+    auto copy = node;
+    EXPECT_EQ_BOOL(copy == node, true);
+    auto hash = node.Hash();
+    copy["List"].push_back(4);
+    EXPECT_EQ_BOOL(copy == node, false);
+    EXPECT_EQ_BOOL(copy.Hash() != hash, true);
+    EXPECT_EQ_BOOL(node.Hash() == hash, true);
+
+    std::unordered_map<SJson::JsonNode, int> cache;
+    cache[node] = 1;
+    EXPECT_EQ_INT(cache[lazy], 1LL);
+    EXPECT_EQ_BOOL(cache.find(copy) == cache.end(), true);
+
+    // Writes through a held reference are never hidden by a cached hash
+    auto held = SJson::JsonConvert::Parse(text);
+    const auto other = SJson::JsonConvert::Parse(text);
+    auto& list = held["List"];
+    auto before = held.Hash();
+    EXPECT_EQ_BOOL(held == other, true);
+    list = 5;
+    EXPECT_EQ_BOOL(held.Hash() != before, true);
+    EXPECT_EQ_BOOL(held == other, false);
+    SJson::JsonNode parent = SJson::array_type_init();
+    parent.push_back(std::move(held));
+    auto parentHash = parent.Hash();
+    list = 6;
+    EXPECT_EQ_BOOL(parent.Hash() != parentHash, true);
+
+    auto huge = SJson::JsonConvert::Parse("[1e400, -1e400]", SJson::LazyParseOption);
+    const auto& hugeElements = huge;
+    EXPECT_EQ_BOOL(huge == SJson::JsonConvert::Parse("[1e400, -1e400]", SJson::LazyParseOption), true);
+    EXPECT_EQ_BOOL(hugeElements[0] == hugeElements[1], false);
+    EXPECT_EQ_BOOL(hugeElements[0].Hash() != hugeElements[1].Hash(), true);
+}
+
+static void test_teardown()
+{
+    // Deep enough to overflow the stack if destruction recursed
+    SJson::JsonNode deep = SJson::array_type_init();
+    for (int i = 0; i < 1000000; i++)
+    {
+        SJson::JsonNode parent = SJson::array_type_init();
+        parent.push_back(std::move(deep));
+        deep = std::move(parent);
+    }
+    auto shared = deep[0][0];
+    deep = SJson::JsonNode();
+    EXPECT_NODE_TYPE(shared, SJson::ValueType::Array);
+    EXPECT_NODE_TYPE(shared[0], SJson::ValueType::Array);
+
+    auto node = SJson::JsonConvert::Parse(JSON);
+    SJson::DeferredRelease(std::move(node));
+    EXPECT_NODE_TYPE(node, SJson::ValueType::Null);
+    SJson::DeferredRelease(SJson::JsonDocument(JSON));
+    SJson::DeferredRelease(std::move(shared));
+    SJson::JsonReclaimer::Instance().Flush();
+}
+
+static void test_memory_usage()
+{
+    auto usage = SJson::JsonNode(1).MemoryUsage();
+    EXPECT_EQ_INT((int64_t)usage.Total(), (int64_t)sizeof(SJson::JsonNode));
+
+    const char* text = R"({"Material": {"Name": "a name longer than the small string buffer", "Color": [1, 1, 1]}})";
+    auto node = SJson::JsonConvert::Parse(text);
+    usage = node.MemoryUsage();
+    EXPECT_EQ_BOOL(usage.Nodes >= 6 * sizeof(SJson::JsonNode), true);
+    EXPECT_EQ_BOOL(usage.Strings > 40, true);
+    EXPECT_EQ_BOOL(usage.Keys >= 3 * sizeof(std::string), true);
+    EXPECT_EQ_INT((int64_t)usage.Packed, 0LL);
+
+    // A shared subtree is counted once
+    auto copy = node["Material"];
+    node["Copy"] = copy;
+    auto shared = node.MemoryUsage();
+    EXPECT_EQ_INT((int64_t)(shared.Strings), (int64_t)usage.Strings);
+
+    auto packed = SJson::JsonConvert::Parse("[1, 2, 3, 4]", SJson::PackedParseOption);
+    EXPECT_EQ_INT((int64_t)packed.MemoryUsage().Packed, (int64_t)(4 * sizeof(int64_t)));
+
+    SJson::JsonDocument document(text);
+    auto documentUsage = document.MemoryUsage();
+    EXPECT_EQ_BOOL(documentUsage.Text > std::strlen(text), true);
+    EXPECT_EQ_BOOL(documentUsage.Strings < usage.Strings, true);
+}
+
+static void test_writer()
+{
+    SJson::JsonWriter writer(SJson::InlineWithQuoteOption);
+    writer.StartObject();
+    writer.Key("Name");
+    writer.Value("camera");
+    writer.Key("Position");
+    writer.StartArray();
+    writer.Value(1);
+    writer.Value(-5);
+    writer.RawValue("2.50");
+    writer.EndArray();
+    writer.Key("Empty");
+    writer.StartObject();
+    writer.EndObject();
+    writer.Key("Visible");
+    writer.Value(true);
+    writer.Key("Parent");
+    writer.Null();
+    writer.EndObject();
+    const char* expected = R"({"Name": "camera", "Position": [1, -5, 2.50], "Empty": {}, "Visible": true, "Parent": null})";
+    EXPECT_EQ_STRING(writer.GetString(), expected);
+
+    auto node = SJson::JsonConvert::Parse(expected);
+    SJson::JsonWriter document(SJson::DocumentOption);
+    node.Write(document);
+    EXPECT_EQ_STRING(document.Take(), node.ToString(SJson::DocumentOption));
+}
+
+static void test_float_format()
+{
+    EXPECT_EQ_STRING(SJson::JsonNode(0.1).ToString(SJson::DefaultOption), "0.1");
+    EXPECT_EQ_STRING(SJson::JsonNode(2.0).ToString(SJson::DefaultOption), "2.0");
+    EXPECT_EQ_STRING(SJson::JsonNode(-0.0).ToString(SJson::DefaultOption), "-0.0");
+    EXPECT_EQ_STRING(SJson::JsonNode(1e300).ToString(SJson::DefaultOption), "1e+300");
+    EXPECT_EQ_STRING(SJson::JsonNode(0.1f).ToString(SJson::DefaultOption), "0.1");
+    EXPECT_EQ_STRING(SJson::JsonNode(static_cast<double>(0.1f)).ToString(SJson::DefaultOption), "0.10000000149011612");
+    EXPECT_EQ_STRING(SJson::JsonNode(std::numeric_limits<double>::infinity()).ToString(SJson::DefaultOption), "null");
+
+    // The output parses back to the same value and type
+    for (double value : { 0.1, 1.0 / 3, 123456789.0, 2.2250738585072014e-308, 1.7976931348623157e308 })
+    {
+        auto node = SJson::JsonConvert::Parse(SJson::JsonNode(value).ToString(SJson::DefaultOption));
+        EXPECT_NODE_TYPE(node, SJson::ValueType::Float);
+        EXPECT_EQ_BOOL(node.Get<double>() == value, true);
+    }
+}
+
+static void test_escaping()
+{
+    SJson::JsonNode node = SJson::object({ {"quote\"key", "a \"b\" \\ c\n\x01"} });
+    auto text = node.ToString(SJson::InlineWithQuoteOption);
+    EXPECT_EQ_STRING(text, R"({"quote\"key": "a \"b\" \\ c\n\u0001"})");
+    auto parsed = SJson::JsonConvert::Parse(text);
+    EXPECT_EQ_BOOL(parsed == node, true);
+
+    // Long enough to take the vectorized scan, with the special character past the first block
+    std::string clean(40, 'x');
+    EXPECT_EQ_STRING(SJson::JsonNode(clean + "\"" + clean).ToString(SJson::DefaultOption), "\"" + clean + "\\\"" + clean + "\"");
+
+    SJson::JsonNode unicode = "caf\xc3\xa9 \xf0\x9f\x98\x80";
+    EXPECT_EQ_STRING(unicode.ToString(SJson::DefaultOption), "\"caf\xc3\xa9 \xf0\x9f\x98\x80\"");
+    SJson::JsonFormatOption ascii = SJson::InlineWithQuoteOption;
+    ascii.EscapeNonAscii = true;
+    EXPECT_EQ_STRING(unicode.ToString(ascii), R"("caf\u00e9 \ud83d\ude00")");
+    EXPECT_EQ_STRING(SJson::JsonConvert::Parse(unicode.ToString(ascii)).Get<std::string>(), unicode.Get<std::string>());
+}
+
+static void test_sinks()
+{
+    auto node = SJson::JsonConvert::Parse(JSON);
+    auto expected = node.ToString(SJson::DocumentOption);
+
+    std::stringstream stream;
+    SJson::JsonStreamSink streamSink(stream);
+    node.WriteTo(streamSink, SJson::DocumentOption);
+    EXPECT_EQ_STRING(stream.str(), expected);
+
+    // Large enough to be handed over in several chunks
+    SJson::JsonNode large = SJson::array_type_init();
+    for (int i = 0; i < 20000; i++)
+    {
+        large.push_back(node);
+    }
+    std::string collected;
+    int chunks = 0;
+    SJson::JsonCallbackSink callbackSink([&](std::string_view data) { collected.append(data); chunks++; });
+    large.WriteTo(callbackSink, SJson::InlineWithQuoteOption);
+    EXPECT_EQ_BOOL(chunks > 1, true);
+    EXPECT_EQ_STRING(collected, large.ToString(SJson::InlineWithQuoteOption));
+
+    FILE* file = std::tmpfile();
+    {
+        SJson::JsonFileSink fileSink(file);
+        SJson::JsonConvert::SerializeTo(std::vector<int>{ 1, 2, 3 }, fileSink, SJson::DefaultOption);
+    }
+    std::rewind(file);
+    char buffer[32] = {};
+    std::fread(buffer, 1, sizeof(buffer) - 1, file);
+    EXPECT_EQ_STRING(std::string(buffer), "[1, 2, 3]");
+
+#ifndef _WIN32
+    std::rewind(file);
+    {
+        SJson::JsonFdSink fdSink(fileno(file));
+        node.WriteTo(fdSink, SJson::DocumentOption);
+    }
+    std::string fromFd(expected.size(), '\0');
+    std::rewind(file);
+    std::fread(fromFd.data(), 1, fromFd.size(), file);
+    EXPECT_EQ_STRING(fromFd, expected);
+#endif
+    std::fclose(file);
+}
+
+static void test_serialized_size()
+{
+    auto node = SJson::JsonConvert::Parse(JSON);
+    node["escaped"] = "tab\tquote\"\u00e9\U0001F600";
+    const SJson::JsonFormatOption asciiOption = { false, true, true, true };
+    for (const auto& option : { SJson::DefaultOption, SJson::InlineWithQuoteOption, SJson::DocumentOption, asciiOption })
+    {
+        EXPECT_EQ_INT(static_cast<int64_t>(node.SerializedSize(option)), static_cast<int64_t>(node.ToString(option).size()));
+    }
+
+    std::map<std::string, std::vector<double>> values = { { "a", { 1.0, 0.1, -2.5e300 } }, { "b\n", {} } };
+    auto size = SJson::JsonConvert::SerializedSize(values, SJson::DocumentOption);
+    std::string buffer(size, '\0');
+    SJson::JsonBufferSink bufferSink(buffer.data(), buffer.size());
+    SJson::JsonConvert::SerializeTo(values, bufferSink, SJson::DocumentOption);
+    EXPECT_EQ_INT(static_cast<int64_t>(bufferSink.Size()), static_cast<int64_t>(size));
+    EXPECT_EQ_STRING(buffer, SJson::JsonConvert::Serialize(values, SJson::DocumentOption));
+
+    SJson::JsonBufferSink smallSink(buffer.data(), size - 1);
+    bool overflow = false;
+    try
+    {
+        SJson::JsonConvert::SerializeTo(values, smallSink, SJson::DocumentOption);
+    }
+    catch (const std::length_error&)
+    {
+        overflow = true;
+    }
+    EXPECT_EQ_BOOL(overflow, true);
+
+    // Measuring first allocates the string once, up to the rounding of the allocator
+    auto measured = SJson::DocumentOption;
+    measured.PreMeasure = true;
+    auto text = node.ToString(measured);
+    EXPECT_EQ_STRING(text, node.ToString(SJson::DocumentOption));
+    EXPECT_EQ_INT(static_cast<int64_t>(text.size()), static_cast<int64_t>(node.SerializedSize(measured)));
+    EXPECT_EQ_BOOL(text.capacity() - text.size() < 16, true);
+    auto serialized = SJson::JsonConvert::Serialize(values, measured);
+    EXPECT_EQ_INT(static_cast<int64_t>(serialized.size()), static_cast<int64_t>(size));
+    EXPECT_EQ_BOOL(serialized.capacity() - serialized.size() < 16, true);
+}
+
+static void test_parallel_writer()
+{
+    SJson::JsonNode large = SJson::array_type_init();
+    std::vector<int64_t> numbers;
+    std::map<int, int> map;
+    for (int i = 0; i < 100000; i++)
+    {
+        large.push_back(SJson::object_type_init{ { "id", i }, { "tags", SJson::array_type_init{ "a", i % 3 == 0 } } });
+        numbers.push_back(i * 7);
+        map[i] = -i;
+    }
+    for (auto option : { SJson::InlineWithQuoteOption, SJson::DocumentOption })
+    {
+        auto expected = large.ToString(option);
+        option.MaxThreads = 4;
+        EXPECT_EQ_BOOL(large.ToString(option) == expected, true);
+        EXPECT_EQ_INT(static_cast<int64_t>(large.SerializedSize(option)), static_cast<int64_t>(expected.size()));
+    }
+
+    auto parallelOption = SJson::DocumentOption;
+    parallelOption.MaxThreads = 4;
+    std::string collected;
+    SJson::JsonCallbackSink callbackSink([&](std::string_view data) { collected.append(data); });
+    SJson::JsonConvert::SerializeTo(numbers, callbackSink, parallelOption);
+    EXPECT_EQ_BOOL(collected == SJson::JsonConvert::Serialize(numbers, SJson::DocumentOption), true);
+    EXPECT_EQ_BOOL(SJson::JsonConvert::Serialize(map, parallelOption) == SJson::JsonConvert::Serialize(map, SJson::DocumentOption), true);
+
+    // Nested long ranges reuse the threads of the pool
+    auto threads = SJson::JsonWorkerPool::Instance().Size();
+    EXPECT_EQ_BOOL(threads >= 4, true);
+    std::vector<std::vector<int64_t>> nested(3, numbers);
+    SJson::JsonConvert::Serialize(nested, parallelOption);
+    EXPECT_EQ_INT(static_cast<int64_t>(SJson::JsonWorkerPool::Instance().Size()), static_cast<int64_t>(threads));
+
+    // A sink failing on a chunk stops the workers and the error reaches the caller
+    std::vector<char> buffer(1024);
+    SJson::JsonBufferSink smallSink(buffer.data(), buffer.size());
+    bool threw = false;
+    try
+    {
+        SJson::JsonConvert::SerializeTo(numbers, smallSink, parallelOption);
+    }
+    catch (const std::length_error&)
+    {
+        threw = true;
+    }
+    EXPECT_EQ_BOOL(threw, true);
+}
+
+static void test_format_options()
+{
+    auto node = SJson::JsonConvert::Parse(R"({"name": "box", "size": [1, 2, 3], "items": [{"id": 1}, [true]], "empty": []})");
+    EXPECT_EQ_STRING(node.ToString(SJson::MinifiedOption), R"({"empty":[],"items":[{"id":1},[true]],"name":"box","size":[1,2,3]})");
+    EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(std::pair<int, int>(1, 2), SJson::MinifiedOption), R"({"key":1,"value":2})");
+
+    SJson::JsonFormatOption wide = SJson::DocumentOption;
+    wide.IndentWidth = 4;
+    wide.ShortArrayLength = 3;
+    const char* expected =
+        "{\n"
+        "    \"empty\": [\n"
+        "    ], \n"
+        "    \"items\": [\n"
+        "        {\n"
+        "            \"id\": 1\n"
+        "        }, \n"
+        "        [true]\n"
+        "    ], \n"
+        "    \"name\": \"box\", \n"
+        "    \"size\": [1, 2, 3]\n"
+        "}";
+    EXPECT_EQ_STRING(node.ToString(wide), expected);
+    EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(std::vector<int>{ 4, 5 }, wide), "[4, 5]");
+    EXPECT_EQ_INT(static_cast<int64_t>(node.SerializedSize(wide)), static_cast<int64_t>(std::strlen(expected)));
+}
+
+static void test_canonical()
+{
+    // Number and key order examples of RFC 8785
+    auto numbers = SJson::JsonConvert::Parse(R"([1e30, 4.50, 2e-3, 0.000000000000000000000000001, -0.0, 333333333.3333333, 1e21, 1e20, 5e-7, 1e-6, 100, -12])");
+    EXPECT_EQ_STRING(numbers.ToCanonical(), "[1e+30,4.5,0.002,1e-27,0,333333333.3333333,1e+21,100000000000000000000,5e-7,0.000001,100,-12]");
+
+    auto keys = SJson::JsonConvert::Parse(R"({"\u20ac": "Euro Sign", "\r": "Carriage Return", "\ufb33": "Hebrew Letter Dalet With Dagesh",
+        "1": "One", "\ud83d\ude00": "Emoji: Grinning Face", "\u0080": "Control", "\u00f6": "Latin Small Letter O With Diaeresis"})");
+    EXPECT_EQ_STRING(keys.ToCanonical(), "{\"\\r\":\"Carriage Return\",\"1\":\"One\",\"\xc2\x80\":\"Control\","
+        "\"\xc3\xb6\":\"Latin Small Letter O With Diaeresis\",\"\xe2\x82\xac\":\"Euro Sign\","
+        "\"\xf0\x9f\x98\x80\":\"Emoji: Grinning Face\",\"\xef\xac\xb3\":\"Hebrew Letter Dalet With Dagesh\"}");
+
+    // Independent of how the tree was built
+    SJson::JsonParseOption lazy = {};
+    lazy.LazyNumbers = true;
+    auto parsed = SJson::JsonConvert::Parse(R"({"b": [1, 2.5, "x"], "a": {"d": null, "c": true}})", lazy);
+    SJson::JsonNode built = SJson::object({ { "a", SJson::object({ { "c", true }, { "d", SJson::JsonNode() } }) }, { "b", SJson::array({ 1, 2.5, "x" }) } });
+    EXPECT_EQ_STRING(parsed.ToCanonical(), R"({"a":{"c":true,"d":null},"b":[1,2.5,"x"]})");
+    EXPECT_EQ_STRING(built.ToCanonical(), parsed.ToCanonical());
+
+    SJson::JsonHashSink sink;
+    auto text = built.ToCanonical();
+    sink.Write(text);
+    EXPECT_EQ_BOOL(built.CanonicalHash() == sink.Hash(), true);
+    EXPECT_EQ_BOOL(parsed.CanonicalHash() == built.CanonicalHash(), true);
+    EXPECT_EQ_BOOL(numbers.CanonicalHash() != built.CanonicalHash(), true);
+
+    // Numbers too small for a double round to zero
+    for (const char* tiny : { "[1e-400]", "[-1e-400]", "[0.00001e-320]", "[123.5e-330]" })
+    {
+        EXPECT_EQ_STRING(SJson::JsonConvert::Parse(tiny, lazy).ToCanonical(), "[0]");
+    }
+
+    // Numbers beyond double are rejected, as when parsing them eagerly
+    for (const char* huge : { "[1e400]", "[-1e400]", "[0.001e312]", "[12345.6e305]" })
+    {
+        bool threw = false;
+        try
+        {
+            SJson::JsonConvert::Parse(huge, lazy).ToCanonical();
+        }
+        catch (const std::out_of_range&)
+        {
+            threw = true;
+        }
+        EXPECT_EQ_BOOL(threw, true);
+    }
+}
+
+static void test_tape()
+{
+    auto tape = SJson::JsonTape::Parse(JSON);
+    auto root = tape.Root();
+    EXPECT_NODE_TYPE(root, SJson::ValueType::Object);
+    EXPECT_EQ_INT((int64_t)root.Size(), 2LL);
+    EXPECT_EQ_STRING(root["Camera"]["Type"].Get<std::string>(), "Normal");
+    EXPECT_EQ_INT(root["Camera"]["Position"][2].Get<int64_t>(), -5LL);
+    EXPECT_EQ_INT(root["Camera"]["FOV"].Get<int64_t>(), 90LL);
+    EXPECT_EQ_FLOAT(root["Objects"][1]["Shape"]["Position"][0].Get<double>(), 1.5);
+    EXPECT_EQ_BOOL(root.Find("Lights").has_value(), false);
+
+    int64_t count = 0;
+    for (auto object : root["Objects"])
+    {
+        EXPECT_EQ_BOOL(object["Type"].GetStringView() == "Geometry", true);
+        count++;
+    }
+    EXPECT_EQ_INT(count, 3LL);
+
+    std::string keys;
+    for (auto [key, value] : root["Camera"].items())
+    {
+        keys.append(key);
+    }
+    EXPECT_EQ_STRING(keys, "TypePositionFOVLookAtUp");
+
+    auto scalars = SJson::JsonTape::Parse(R"([null, true, "a\tb", {}, []])");
+    EXPECT_NODE_TYPE(scalars.Root()[0], SJson::ValueType::Null);
+    EXPECT_EQ_BOOL(scalars.Root()[1].Get<bool>(), true);
+    EXPECT_EQ_STRING(scalars.Root()[2].Get<std::string>(), "a\tb");
+    EXPECT_EQ_INT((int64_t)scalars.Root()[3].Size(), 0LL);
+    EXPECT_EQ_INT((int64_t)scalars.Root()[4].Size(), 0LL);
+    EXPECT_EQ_INT((int64_t)scalars.Root().Size(), 5LL);
+
+    // Keys are unescaped like string values
+    auto escaped = SJson::JsonTape::Parse(R"({"a\"b": 1, "\u0041": 2})");
+    EXPECT_EQ_INT(escaped.Root()["a\"b"].Get<int64_t>(), 1LL);
+    EXPECT_EQ_INT(escaped.Root()["A"].Get<int64_t>(), 2LL);
+
+    // Elements point into heap storage that moves with the tape
+    auto camera = root["Camera"];
+    auto moved = std::move(tape);
+    EXPECT_EQ_INT(camera["FOV"].Get<int64_t>(), 90LL);
+
+    EXPECT_PARSE_THROW_TAPE("[1, 2", SJson::expect_token_error);
+    EXPECT_PARSE_THROW_TAPE("{1: 2}", SJson::keys_not_string);
+    EXPECT_PARSE_THROW_TAPE("[] []", SJson::root_not_singular_error);
+}
+
+static void test_find()
+{
+    auto node = SJson::JsonConvert::Parse(JSON);
+    std::string_view camera = "Camera";
+    EXPECT_EQ_INT(node[camera]["FOV"], 90LL);
+    EXPECT_EQ_STRING(node[std::string("Camera")]["Type"], "Normal");
+    EXPECT_EQ_BOOL(node.Find("Lights") == nullptr, true);
+    EXPECT_EQ_BOOL(node["Camera"]["FOV"].Find("Type") == nullptr, true);
+
+    const SJson::JsonNode& constNode = node;
+    auto fov = constNode.Find("Camera")->Find("FOV");
+    EXPECT_EQ_BOOL(fov != nullptr, true);
+    EXPECT_EQ_INT(*fov, 90LL);
+
+    node[camera]["Near"] = 0.1;
+    EXPECT_EQ_FLOAT(node["Camera"]["Near"], 0.1);
+}
+
+static void test_json_key()
+{
+    using namespace SJson::literals;
+    constexpr auto cameraKey = "Camera"_jk;
+    static_assert(cameraKey.Hash() == SJson::hash_key("Camera"));
+
+    auto node = SJson::JsonConvert::Parse(JSON);
+    EXPECT_EQ_STRING(node[cameraKey]["Type"_jk], "Normal");
+    EXPECT_EQ_BOOL(node.Find("Lights"_jk) == nullptr, true);
+
+    // Large enough to be indexed
+    SJson::JsonNode large;
+    for (int i = 0; i < 100; i++)
+    {
+        large["Key" + std::to_string(i)] = i;
+    }
+    for (int i = 0; i < 100; i++)
+    {
+        std::string name = "Key" + std::to_string(i);
+        EXPECT_EQ_INT(large[SJson::JsonKey(name)], (int64_t)i);
+    }
+    large[SJson::JsonKey("Extra")] = "extra";
+    EXPECT_EQ_STRING(large["Extra"_jk], "extra");
+    EXPECT_EQ_INT((int64_t)large.AsObject().erase("Key50"), 1LL);
+    EXPECT_EQ_BOOL(large.Find("Key50"_jk) == nullptr, true);
+    EXPECT_EQ_INT(large["Key51"_jk], 51LL);
+
+    // Erasing keeps the remaining keys reachable through the index
+    for (int i = 0; i < 100; i += 3)
+    {
+        large.AsObject().erase("Key" + std::to_string(i));
+    }
+    for (int i = 0; i < 100; i++)
+    {
+        auto member = large.Find(SJson::JsonKey("Key" + std::to_string(i)));
+        EXPECT_EQ_BOOL(member != nullptr, i % 3 != 0 && i != 50);
+    }
+
+    SJson::JsonNode copy = large;
+    large["Key1"_jk] = -1;
+    EXPECT_EQ_INT(copy["Key1"_jk], 1LL);
+    EXPECT_EQ_INT(large["Key1"_jk], -1LL);
+}
+
+static void test_iterators()
+{
+    auto node = SJson::JsonConvert::Parse(R"({"Values": [1, 2, 3, 4], "A": 1, "B": "b"})");
+    int64_t sum = 0;
+    for (auto& value : node["Values"])
+    {
+        sum += value.Get<int64_t>();
+    }
+    EXPECT_EQ_INT(sum, 10LL);
+
+    for (auto& value : node["Values"])
+    {
+        value = value.Get<int64_t>() * 2;
+    }
+    EXPECT_EQ_INT(node["Values"][3], 8LL);
+
+    std::string keys;
+    for (auto& [key, value] : node.items())
+    {
+        keys.append(key);
+    }
+    EXPECT_EQ_STRING(keys, "ABValues");
+
+    int64_t count = 0;
+    node["Values"].foreach([&](const SJson::JsonNode&) { count++; });
+    node.foreach_pairs([&](const std::string&, const SJson::JsonNode&) { count++; });
+    EXPECT_EQ_INT(count, 7LL);
+}
+
+static void test_lazy_numbers()
+{
+    std::string text = R"([123456789012345678901234567890, 0.1, 3.14e+19, -42, +7, 0.e14, 1.2345678901234567890123])";
+    SJson::JsonParseOption borrowed = SJson::LazyParseOption;
+    borrowed.BorrowStrings = true;
+    auto node = SJson::JsonConvert::Parse(text, borrowed);
+    EXPECT_NODE_TYPE(node[0], SJson::ValueType::Integer);
+    EXPECT_NODE_TYPE(node[1], SJson::ValueType::Float);
+    EXPECT_EQ_BOOL(node[0].IsLazyNumber(), true);
+    EXPECT_EQ_BOOL(node[0].IsBorrowed(), true);
+    EXPECT_EQ_BOOL(SJson::JsonConvert::Parse(text, SJson::LazyParseOption)[0].IsBorrowed(), false);
+    // Lexemes outside RFC 8259 are converted right away
+    EXPECT_EQ_BOOL(node[4].IsLazyNumber(), false);
+    EXPECT_EQ_BOOL(node[5].IsLazyNumber(), false);
+    EXPECT_EQ_FLOAT(node[1], 0.1);
+    EXPECT_EQ_FLOAT(node[1], 0.1);
+    EXPECT_EQ_FLOAT(node[2], 3.14e19);
+    EXPECT_EQ_INT(node[3], -42LL);
+    EXPECT_EQ_INT(node[4], 7LL);
+    EXPECT_EQ_FLOAT(node[5], 0.0);
+    EXPECT_EQ_FLOAT(node[6], 1.2345678901234567);
+    EXPECT_EQ_STRING(node.ToString(SJson::DefaultOption),
+        "[123456789012345678901234567890, 0.1, 3.14e+19, -42, 7, 0.0, 1.2345678901234567890123]");
+
+    bool thrown = false;
+    try
+    {
+        node[0].Get<int64_t>();
+    }
+    catch (std::out_of_range&)
+    {
+        thrown = true;
+    }
+    EXPECT_EQ_BOOL(thrown, true);
+
+    // A float read as an integer must not reinterpret the cached bits
+    thrown = false;
+    try
+    {
+        node[1].Get<int64_t>();
+    }
+    catch (std::bad_variant_access&)
+    {
+        thrown = true;
+    }
+    EXPECT_EQ_BOOL(thrown, true);
+
+    // Integers convert to floating point on demand, beyond int64_t too
+    EXPECT_EQ_FLOAT(node[0].Get<double>(), 1.2345678901234568e29);
+    EXPECT_EQ_FLOAT(node[3].Get<double>(), -42.0);
+    EXPECT_EQ_INT(node[3], -42LL);
+    EXPECT_EQ_FLOAT(SJson::JsonNode(7).Get<double>(), 7.0);
+
+    node.MakeOwned();
+    auto copy = node;
+    text.assign(text.size(), ' ');
+    EXPECT_EQ_STRING(std::string(copy[0].GetNumberText()), "123456789012345678901234567890");
+    EXPECT_EQ_INT(copy[3], -42LL);
+
+    auto big = SJson::number("18446744073709551616");
+    EXPECT_NODE_TYPE(big, SJson::ValueType::Integer);
+    EXPECT_EQ_STRING(big.ToString(SJson::DefaultOption), "18446744073709551616");
+    EXPECT_EQ_FLOAT(SJson::number("2.5"), 2.5);
+    EXPECT_EQ_BOOL(SJson::JsonConvert::Parse("[007, .5]", SJson::LazyParseOption).ToString(SJson::DefaultOption) == "[7, 0.5]", true);
+}
+
+static void test_packed_arrays()
+{
+    auto node = SJson::JsonConvert::Parse(JSON, SJson::PackedParseOption);
+    auto& position = node["Camera"]["Position"];
+    EXPECT_EQ_BOOL(position.IsPacked(), true);
+    EXPECT_EQ_INT((int64_t)position.Size(), 3LL);
+    auto ints = position.GetNumbers<int64_t>();
+    EXPECT_EQ_INT(ints[2], -5LL);
+
+    // Const element access works on the packed numbers
+    const auto& constPosition = position;
+    EXPECT_EQ_INT(constPosition[2], -5LL);
+    EXPECT_EQ_INT((int64_t)constPosition.AsArray().size(), 3LL);
+    int64_t sum = 0;
+    for (auto& element : constPosition)
+    {
+        sum += element.Get<int64_t>();
+    }
+    EXPECT_EQ_INT(sum, -5LL);
+    EXPECT_EQ_BOOL(position.IsPacked(), true);
+
+    // Indexed reads only build the elements they touch, also from several threads
+    std::string text = "[0";
+    for (int i = 1; i < 1000; i++)
+    {
+        text += ", " + std::to_string(i);
+    }
+    text += "]";
+    const auto large = SJson::JsonConvert::Parse(text, SJson::PackedParseOption);
+    auto nodesBefore = large.MemoryUsage().Nodes;
+    std::vector<std::thread> readers;
+    std::atomic<int> wrong = 0;
+    for (int t = 0; t < 4; t++)
+    {
+        readers.emplace_back([&]() {
+            for (int i = 0; i < 100; i++)
+            {
+                wrong += large[i % 10].Get<int64_t>() != i % 10;
+                large.MemoryUsage();
+            }
+        });
+    }
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+    EXPECT_EQ_INT((int64_t)wrong.load(), 0LL);
+    EXPECT_EQ_BOOL(&large[3] == &large[3], true);
+    EXPECT_EQ_BOOL(large.MemoryUsage().Nodes - nodesBefore < 100 * sizeof(SJson::JsonNode), true);
+
+    // Integers and floats mixed in one array keep their types
+    auto& mixed = node["Objects"][0]["Shape"]["Position"];
+    EXPECT_EQ_BOOL(mixed.IsPacked(), false);
+    EXPECT_EQ_INT(mixed[1], 0LL);
+    EXPECT_EQ_STRING(mixed.ToString(SJson::DefaultOption), "[-1.5, 0, 0]");
+    std::vector<float> floats;
+    mixed.CopyNumbers(floats);
+    EXPECT_EQ_VECTOR(floats, std::vector<float>({ -1.5f, 0.f, 0.f }));
+
+    EXPECT_EQ_STRING(position.ToString(SJson::DefaultOption), "[0, 0, -5]");
+    auto v = SJson::de_serialize<std::vector<int>>(position);
+    EXPECT_EQ_VECTOR(v, std::vector<int>({ 0, 0, -5 }));
+
+    // Element access through a mutable node unpacks the array
+    position[0] = "x";
+    EXPECT_EQ_BOOL(position.IsPacked(), false);
+    EXPECT_EQ_STRING(position[0], "x");
+    EXPECT_EQ_INT(position[2], -5LL);
+
+    auto notPacked = SJson::JsonConvert::Parse("[1, \"a\", 2]", SJson::PackedParseOption);
+    EXPECT_EQ_BOOL(notPacked.IsPacked(), false);
+    auto empty = SJson::JsonConvert::Parse("[]", SJson::PackedParseOption);
+    EXPECT_EQ_BOOL(empty.IsPacked(), false);
+}
+
+static void test_copy_on_write()
+{
+    auto node = SJson::JsonConvert::Parse(R"({"List": [1, 2, 3], "Obj": {"A": "a"}})");
+    const SJson::JsonNode copy = node;
+    EXPECT_EQ_BOOL(node.IsShared(), true);
+    EXPECT_EQ_BOOL(&copy["Obj"] == &static_cast<const SJson::JsonNode&>(node)["Obj"], true);
+
+    node["Obj"]["B"] = "b";
+    EXPECT_EQ_BOOL(node.IsShared(), false);
+    EXPECT_EQ_INT((int64_t)node["Obj"].Size(), 2LL);
+    EXPECT_EQ_INT((int64_t)copy["Obj"].Size(), 1LL);
+    EXPECT_EQ_BOOL(copy["Obj"].Find("B") == nullptr, true);
+    // Only the modified path is detached, the untouched subtree is still shared
+    EXPECT_EQ_BOOL(node["List"].IsShared(), true);
+    node["List"][0] = 10;
+    EXPECT_EQ_INT(node["List"][0], 10LL);
+    EXPECT_EQ_INT(copy["List"][0], 1LL);
+
+    auto packed = SJson::JsonConvert::Parse("[1, 2, 3]", SJson::PackedParseOption);
+    auto packedCopy = packed;
+    packed.push_back(4);
+    EXPECT_EQ_BOOL(packedCopy.IsPacked(), true);
+    EXPECT_EQ_INT((int64_t)packedCopy.Size(), 3LL);
+    EXPECT_EQ_INT((int64_t)packed.Size(), 4LL);
+
+    // A copy made while a kept reference is held does not see writes through it
+    auto config = SJson::JsonConvert::Parse(R"({"Camera": {"FOV": 45}, "Scale": [1, 2]})");
+    auto& fov = *config.Find("Camera")->Find("FOV");
+    auto& scale = config.Find("Scale")->AsArray()[0];
+    const SJson::JsonNode snapshot = config;
+    fov = 60;
+    scale = 5;
+    EXPECT_EQ_INT(snapshot["Camera"]["FOV"], 45LL);
+    EXPECT_EQ_INT(snapshot["Scale"][0], 1LL);
+    EXPECT_EQ_INT(config["Camera"]["FOV"], 60LL);
+    SJson::JsonNode assigned;
+    assigned = config;
+    fov = 90;
+    EXPECT_EQ_INT(assigned["Camera"]["FOV"], 60LL);
+
+    // Reads and writes through operator[] keep later copies cheap
+    auto document = SJson::JsonConvert::Parse(R"({"Camera": {"FOV": 45}, "Scale": [1, 2]})");
+    EXPECT_EQ_INT(document["Camera"]["FOV"], 45LL);
+    document["Scale"][1] = 3;
+    const SJson::JsonNode cheap = document;
+    EXPECT_EQ_BOOL(cheap.IsShared(), true);
+    EXPECT_EQ_BOOL(&cheap["Camera"] == &static_cast<const SJson::JsonNode&>(document)["Camera"], true);
+
+    // Const access neither detaches nor prevents sharing
+    const SJson::JsonNode& view = copy;
+    const SJson::JsonNode shared = view;
+    EXPECT_EQ_INT(view["List"][1], 2LL);
+    EXPECT_EQ_BOOL(view.IsShared(), true);
+    EXPECT_EQ_BOOL(&shared["List"] == &view["List"], true);
+}
+
 
 enum class SType
 {
@@ -897,7 +1786,7 @@ static void test_serialization()
 
     EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(155541213, SJson::DefaultOption), "155541213");
 
-    EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(3.14159265358, SJson::DefaultOption), "3.1415926535800001");
+    EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(3.14159265358, SJson::DefaultOption), "3.14159265358");
 
     EXPECT_EQ_STRING(SJson::JsonConvert::Serialize("hello world", SJson::DefaultOption), R"("hello world")");
 
@@ -908,10 +1797,10 @@ static void test_serialization()
     EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(strArr, SJson::DefaultOption), R"(["a", "b", "c"])");
 
     std::tuple<int, float, std::string> tuple1 = { 114514, 3.14159, "test"};
-    EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(tuple1, SJson::DefaultOption), R"([114514, 3.1415901184082031, "test"])");
+    EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(tuple1, SJson::DefaultOption), R"([114514, 3.14159, "test"])");
 
     std::map<int, double> map1 = { {1, 3.14}, {2, 6.28} };
-    EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(map1, SJson::DefaultOption), R"([{key: 1, value: 3.1400000000000001}, {key: 2, value: 6.2800000000000002}])");
+    EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(map1, SJson::DefaultOption), R"([{key: 1, value: 3.14}, {key: 2, value: 6.28}])");
 
     std::map<std::string, int> map2 = { {"A", 1}, {"B", 2} };
     EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(map2, SJson::DefaultOption), R"([{key: "A", value: 1}, {key: "B", value: 2}])");
@@ -930,7 +1819,17 @@ static void test_serialization()
     test.ParentAge2 = 54;
     test.EnumValue = SType::C;
     EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(test, SJson::DefaultOption),
-        R"({$TestParent: {ParentAge: 55}, $TestParent2: {ParentAge2: 54}, Age: 21, EnumValue: "C", InternalData: {A: 0, B: 0.00000000000000000}, List: [1, 2, 3], Male: true, Mapp: [{key: 1, value: ["A", "B"]}, {key: 2, value: ["C", "D"]}], Name: "DXTsT", Weight: 199.44999694824218750})");
+        R"({$TestParent: {ParentAge: 55}, $TestParent2: {ParentAge2: 54}, Age: 21, EnumValue: "C", InternalData: {A: 0, B: 0.0}, List: [1, 2, 3], Male: true, Mapp: [{key: 1, value: ["A", "B"]}, {key: 2, value: ["C", "D"]}], Name: "DXTsT", Weight: 199.45})");
+
+    // The direct writer path matches the tree path
+    EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(test, SJson::DocumentOption), SJson::serialize(test).ToString(SJson::DocumentOption));
+    auto node = SJson::serialize(test);
+    EXPECT_EQ_STRING(SJson::JsonConvert::Serialize(node, SJson::DefaultOption), node.ToString(SJson::DefaultOption));
+
+    using members = SJson::reflected_members<TestObject>;
+    EXPECT_EQ_STRING(std::string(SJson::reflected_key<TestObject, 0>::Literal.Quoted), "\"Age\": ");
+    EXPECT_EQ_STRING(std::string(SJson::reflected_key<TestObject, 0>::Literal.Unquoted), "Age: ");
+    EXPECT_EQ_STRING(std::string(SJson::reflected_key<TestObject, members::FieldCount>::Literal.Quoted), "\"$TestParent\": ");
 }
 
 
@@ -1002,6 +1901,29 @@ static void test_parse()
     test_parse_object();
     test_parse_json();
     test_to_string();
+    test_borrowed_strings();
+    test_move_out();
+    test_move_node();
+    test_snapshot();
+    test_tape();
+    test_find();
+    test_json_key();
+    test_iterators();
+    test_lazy_numbers();
+    test_packed_arrays();
+    test_copy_on_write();
+    test_deduplicate();
+    test_equality();
+    test_teardown();
+    test_memory_usage();
+    test_writer();
+    test_float_format();
+    test_escaping();
+    test_sinks();
+    test_serialized_size();
+    test_parallel_writer();
+    test_format_options();
+    test_canonical();
     test_serialization();
     test_deserialization();
 }